@@ -0,0 +1,79 @@
+// dfsph.glsl
+#ifndef DFSPH
+#define DFSPH
+#include "header.glsl"
+#include "sphKernels.glsl"
+
+// divergence free SPH. a divergence solve first makes the velocities divergence free for the
+// densities of the step, then a density solve corrects the predicted velocities until the density
+// error is below densityTolerance. both are Jacobi iterations whose error a workgroup reduction sums
+// on the GPU, iterations after convergence return right away so the host never waits for the error
+layout(constant_id = 18) const float densityTolerance = 0.001;   // average relative density error
+layout(constant_id = 19) const float divergenceTolerance = 0.01; // average relative density change over one step
+
+const uint MIN_DIVERGENCE_ITERATIONS = 1;
+const uint MIN_DENSITY_ITERATIONS = 2;
+// errors are summed in fixed point, atomics on floats are an extension. the sums are over all particles
+// and only divided by the particle count when they are compared, so small errors of many particles still add up.
+// a sum that would overflow sticks at the largest value, which never counts as converged
+const float ERROR_SCALE = 4096.0;
+const uint ERROR_SUM_MAX = 0xFFFFFFFFu;
+
+// add value to the error sum in the buffer member sum, a macro since atomics only work on the member itself
+#define SATURATING_ADD(sum, value)                                                                    \
+    {                                                                                                 \
+        uint expected = sum;                                                                          \
+        for (;;)                                                                                      \
+        {                                                                                             \
+            uint desired = expected > ERROR_SUM_MAX - (value) ? ERROR_SUM_MAX : expected + (value);   \
+            uint seen = atomicCompSwap(sum, expected, desired);                                       \
+            if (seen == expected)                                                                     \
+                break;                                                                                \
+            expected = seen;                                                                          \
+        }                                                                                             \
+    }
+
+// average relative error of a sum
+float averageError(uint errorSum)
+{
+    return float(errorSum) / (ERROR_SCALE * float(PARTICLE_COUNT));
+}
+
+struct DfsphState
+{
+    // cleared every step, iteration k sums its error into slot k % 2 while the other one is cleared
+    uint divergenceError[2];
+    uint densityError[2];
+    uint divergenceDone;
+    uint densityDone;
+    // summed over the steps of a submit and copied out for the host
+    uint steps;
+    uint divergenceIterations;
+    uint densityIterations;
+    uint lastDensityError; // error sum the last density solve ended with, fixed point
+};
+
+layout(std430, binding = 12) buffer kappaBuffer {
+    float kappas[]; // stiffness of the running iteration, shares the PBF lambda buffer
+} KappaData;
+
+layout(std430, binding = 13) buffer alphaBuffer {
+    float alphas[];
+} AlphaData;
+
+layout(std430, binding = 14) buffer dfsphStateBuffer {
+    DfsphState state;
+} DfsphData;
+
+// the walls are static boundary particles mirrored at the wall like in the SPH passes,
+// side 0 is the wall at domainMin. false when the mirror is out of range
+bool mirrorOffset(vec3 position, int axis, int side, out vec3 rVec, out float r2)
+{
+    float wall = side == 0 ? domainMin[axis] : domainMax[axis];
+    rVec = vec3(0.0);
+    rVec[axis] = 2.0 * (position[axis] - wall);
+    r2 = rVec[axis] * rVec[axis];
+    return r2 > 0.0 && r2 <= smoothingLengthSquared;
+}
+
+#endif
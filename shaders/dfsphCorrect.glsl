@@ -0,0 +1,113 @@
+// dfsphCorrect.glsl
+// velocity correction pass of the DFSPH solves, define DENSITY_SOLVE before including it for the
+// density solve, otherwise it is the divergence solve. the density solve works on the predicted velocities
+#include "header.glsl"
+#include "grid.glsl"
+#include "dfsph.glsl"
+
+layout(local_size_x_id = 2) in; // Define the number of threads per workgroup
+
+layout(push_constant) uniform PushConstants {
+    float dt;
+    uint writeRenderCopy;
+    uint iteration;
+} pc;
+
+layout(std430, binding = 0) readonly buffer positionBuffer {
+	vec4 positions[];
+} PositionData;
+
+#ifdef DENSITY_SOLVE
+layout(std430, binding = 2) buffer predictedVelocityBuffer {
+	vec4 velocities[];
+} VelocityData;
+#else
+layout(std430, binding = 1) buffer velocityBuffer {
+	vec4 velocities[];
+} VelocityData;
+#endif
+
+layout(std430, binding = 3) readonly buffer densityBuffer {
+	float densities[];
+} DensityData;
+
+// checks the error the stiffness pass summed, and when it is still too large
+// pushes the particle along the stiffness gradient
+void main()
+{
+    uint global_id = gl_GlobalInvocationID.x;
+
+#ifdef DENSITY_SOLVE
+    if (DfsphData.state.densityDone != 0) return;
+    uint errorSum = DfsphData.state.densityError[pc.iteration & 1];
+    bool converged = pc.iteration >= MIN_DENSITY_ITERATIONS && averageError(errorSum) <= densityTolerance;
+#else
+    if (DfsphData.state.divergenceDone != 0) return;
+    uint errorSum = DfsphData.state.divergenceError[pc.iteration & 1];
+    bool converged = pc.iteration >= MIN_DIVERGENCE_ITERATIONS && averageError(errorSum) <= divergenceTolerance;
+#endif
+
+    // every thread reads the same sum, the slot of the next iteration is not read by anyone in this pass
+    if (global_id == 0)
+    {
+#ifdef DENSITY_SOLVE
+        DfsphData.state.densityError[(pc.iteration + 1) & 1] = 0;
+        DfsphData.state.lastDensityError = errorSum;
+        if (converged)
+            DfsphData.state.densityDone = 1;
+        else
+            DfsphData.state.densityIterations++;
+#else
+        DfsphData.state.divergenceError[(pc.iteration + 1) & 1] = 0;
+        if (converged)
+            DfsphData.state.divergenceDone = 1;
+        else
+            DfsphData.state.divergenceIterations++;
+#endif
+    }
+
+    // Ensure we do not access out of bounds
+    if (converged || global_id >= PARTICLE_COUNT) return;
+
+    vec3 currentPosition = PositionData.positions[global_id].xyz;
+    float currentStiffness = KappaData.kappas[global_id] / DensityData.densities[global_id];
+    vec3 correction = vec3(0.0);
+
+    // only the 27 cells around this particle can be in range
+    ivec3 currentCell = cellCoord(currentPosition);
+    for (int z = -1; z <= 1; ++z)
+    for (int y = -1; y <= 1; ++y)
+    for (int x = -1; x <= 1; ++x)
+    {
+        ivec3 neighborCell = currentCell + ivec3(x, y, z);
+        if (!isCellInGrid(neighborCell)) continue;
+
+        uint cell = cellIndex(neighborCell);
+        uint cellBegin = CellData.cells[cell].start;
+        uint cellEnd = cellBegin + CellData.cells[cell].count;
+        for (uint j = cellBegin; j < cellEnd; ++j)
+        {
+            uint i = SortedIndexData.sortedIndices[j];
+            if (global_id == i) continue; // skip the current particle
+
+            vec3 rVec = currentPosition - PositionData.positions[i].xyz;
+            float r2;
+            if (!inKernelRange(rVec, r2) || r2 <= 0.0) continue;
+
+            float stiffnessSum = currentStiffness + KappaData.kappas[i] / DensityData.densities[i];
+            correction += particleMass * stiffnessSum * spikyKernelGradient(rVec, sqrt(r2));
+        }
+    }
+
+    // the walls only push back with the stiffness of the particle
+    for (int axis = 0; axis < 3; ++axis)
+    for (int side = 0; side < 2; ++side)
+    {
+        vec3 rVec;
+        float r2;
+        if (mirrorOffset(currentPosition, axis, side, rVec, r2))
+            correction += particleMass * currentStiffness * spikyKernelGradient(rVec, sqrt(r2));
+    }
+
+    VelocityData.velocities[global_id].xyz -= pc.dt * correction;
+}
@@ -0,0 +1,129 @@
+// dfsphKappa.glsl
+// stiffness pass of the DFSPH solves, define DENSITY_SOLVE before including it for the density solve,
+// otherwise it is the divergence solve. the density solve works on the predicted velocities
+#include "header.glsl"
+#include "grid.glsl"
+#include "dfsph.glsl"
+
+layout(local_size_x_id = 2) in; // Define the number of threads per workgroup
+
+layout(push_constant) uniform PushConstants {
+    float dt;
+    uint writeRenderCopy;
+    uint iteration;
+} pc;
+
+layout(std430, binding = 0) readonly buffer positionBuffer {
+	vec4 positions[];
+} PositionData;
+
+#ifdef DENSITY_SOLVE
+layout(std430, binding = 2) readonly buffer predictedVelocityBuffer {
+	vec4 velocities[];
+} VelocityData;
+#else
+layout(std430, binding = 1) readonly buffer velocityBuffer {
+	vec4 velocities[];
+} VelocityData;
+#endif
+
+layout(std430, binding = 3) readonly buffer densityBuffer {
+	float densities[];
+} DensityData;
+
+shared float groupError[THREADS_PER_GROUP];
+
+// how fast the density changes with the current velocities, turned into a stiffness
+// the error of every particle is summed for the convergence check of the correction pass
+void main()
+{
+#ifdef DENSITY_SOLVE
+    if (DfsphData.state.densityDone != 0) return;
+#else
+    if (DfsphData.state.divergenceDone != 0) return;
+#endif
+
+    uint local_id = gl_LocalInvocationID.x;
+    uint global_id = gl_GlobalInvocationID.x;
+
+    // threads past the end still take part in the reduction
+    float error = 0.0;
+    if (global_id < PARTICLE_COUNT)
+    {
+        vec3 currentPosition = PositionData.positions[global_id].xyz;
+        vec3 currentVelocity = VelocityData.velocities[global_id].xyz;
+
+        float densityChange = 0.0;
+
+        // only the 27 cells around this particle can be in range
+        ivec3 currentCell = cellCoord(currentPosition);
+        for (int z = -1; z <= 1; ++z)
+        for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+        {
+            ivec3 neighborCell = currentCell + ivec3(x, y, z);
+            if (!isCellInGrid(neighborCell)) continue;
+
+            uint cell = cellIndex(neighborCell);
+            uint cellBegin = CellData.cells[cell].start;
+            uint cellEnd = cellBegin + CellData.cells[cell].count;
+            for (uint j = cellBegin; j < cellEnd; ++j)
+            {
+                uint i = SortedIndexData.sortedIndices[j];
+                if (global_id == i) continue; // skip the current particle
+
+                vec3 rVec = currentPosition - PositionData.positions[i].xyz;
+                float r2;
+                if (!inKernelRange(rVec, r2) || r2 <= 0.0) continue;
+
+                vec3 relativeVelocity = currentVelocity - VelocityData.velocities[i].xyz;
+                densityChange += particleMass * dot(relativeVelocity, spikyKernelGradient(rVec, sqrt(r2)));
+            }
+        }
+
+        // the walls stand still
+        for (int axis = 0; axis < 3; ++axis)
+        for (int side = 0; side < 2; ++side)
+        {
+            vec3 rVec;
+            float r2;
+            if (mirrorOffset(currentPosition, axis, side, rVec, r2))
+                densityChange += particleMass * dot(currentVelocity, spikyKernelGradient(rVec, sqrt(r2)));
+        }
+
+        // only compression is corrected, a particle at the free surface may lose density
+        float alpha = AlphaData.alphas[global_id];
+#ifdef DENSITY_SOLVE
+        float compression = max(DensityData.densities[global_id] + pc.dt * densityChange - incompressibleRestDensity, 0.0);
+        KappaData.kappas[global_id] = compression / (pc.dt * pc.dt) * alpha;
+        error = compression / incompressibleRestDensity;
+#else
+        float compression = max(densityChange, 0.0);
+        KappaData.kappas[global_id] = compression / pc.dt * alpha;
+        error = compression * pc.dt / incompressibleRestDensity;
+#endif
+    }
+    groupError[local_id] = error;
+    barrier();
+
+    // halve the active threads every round, works for any workgroup size
+    for (uint active = THREADS_PER_GROUP; active > 1; )
+    {
+        uint halfCount = (active + 1) / 2;
+        if (local_id < active - halfCount)
+            groupError[local_id] += groupError[local_id + halfCount];
+        barrier();
+        active = halfCount;
+    }
+
+    // the error of the workgroup added to the sum of all particles, saturating instead of wrapping around
+    if (local_id == 0)
+    {
+        uint scaled = uint(min(groupError[0] * ERROR_SCALE, float(ERROR_SUM_MAX)));
+#ifdef DENSITY_SOLVE
+        SATURATING_ADD(DfsphData.state.densityError[pc.iteration & 1], scaled)
+#else
+        SATURATING_ADD(DfsphData.state.divergenceError[pc.iteration & 1], scaled)
+#endif
+    }
+}
@@ -0,0 +1,70 @@
+#version 450
+// water shading of the smoothed fluid depth. the view position of every pixel comes back from its depth,
+// the normal from the positions of the neighbors on the side with the smaller depth step so the
+// silhouettes do not bend. the thickness sets how much of the background shows through
+
+layout (location = 0) out vec4 outFragColor;
+
+layout( set = 0, binding = 0 ) uniform CameraBuffer
+{
+	mat4 proj;
+	mat4 view;
+	mat4 model;
+} cameraData;
+
+layout(set = 0, binding = 1) uniform sampler2D fluidDepth;
+layout(set = 0, binding = 2) uniform sampler2D fluidThickness;
+
+vec3 viewPosition(ivec2 pixel, float depth)
+{
+	vec2 ndc = (vec2(pixel) + 0.5) / vec2(textureSize(fluidDepth, 0)) * 2.0 - 1.0;
+	return vec3(ndc.x * depth / cameraData.proj[0][0], ndc.y * depth / cameraData.proj[1][1], -depth);
+}
+
+// the difference to the neighbor on the side where the fluid continues more smoothly
+vec3 positionStep(ivec2 pixel, vec3 center, ivec2 offset)
+{
+	ivec2 size = textureSize(fluidDepth, 0);
+	ivec2 after = clamp(pixel + offset, ivec2(0), size - 1);
+	ivec2 before = clamp(pixel - offset, ivec2(0), size - 1);
+	float afterDepth = texelFetch(fluidDepth, after, 0).r;
+	float beforeDepth = texelFetch(fluidDepth, before, 0).r;
+	vec3 forward = afterDepth > 0.0 ? viewPosition(after, afterDepth) - center : vec3(0.0);
+	vec3 backward = beforeDepth > 0.0 ? center - viewPosition(before, beforeDepth) : vec3(0.0);
+	if (afterDepth <= 0.0)
+		return backward;
+	if (beforeDepth <= 0.0 || abs(forward.z) < abs(backward.z))
+		return forward;
+	return backward;
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(fluidDepth, pixel, 0).r;
+	if (depth <= 0.0)
+		discard;
+
+	vec3 position = viewPosition(pixel, depth);
+	vec3 normal = cross(positionStep(pixel, position, ivec2(1, 0)), positionStep(pixel, position, ivec2(0, 1)));
+	vec3 toCamera = normalize(-position);
+	normal = length(normal) > 0.0 ? normalize(normal) : toCamera;
+	if (dot(normal, toCamera) < 0.0)
+		normal = -normal;
+
+	// a light above and behind the camera, Schlick's fresnel for the reflection of the sky
+	vec3 lightDir = normalize(mat3(cameraData.view) * vec3(0.3, 1.0, 0.5));
+	float diffuse = max(dot(normal, lightDir), 0.0);
+	float specular = pow(max(dot(normal, normalize(lightDir + toCamera)), 0.0), 64.0);
+	float fresnel = 0.02 + 0.98 * pow(1.0 - max(dot(normal, toCamera), 0.0), 5.0);
+
+	// Beer-Lambert absorption, red goes first so thick water gets deep blue
+	float thickness = texelFetch(fluidThickness, pixel, 0).r;
+	vec3 transmittance = exp(-vec3(0.45, 0.2, 0.08) * thickness);
+	vec3 water = mix(vec3(0.02, 0.15, 0.4), vec3(0.3, 0.6, 0.9), transmittance) * (0.35 + 0.65 * diffuse);
+	vec3 sky = vec3(0.75, 0.85, 1.0);
+	vec3 color = mix(water, sky, fresnel) + vec3(specular);
+
+	float opacity = clamp(max(1.0 - dot(transmittance, vec3(1.0 / 3.0)), fresnel), 0.0, 1.0);
+	outFragColor = vec4(color, opacity);
+}
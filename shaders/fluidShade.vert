@@ -0,0 +1,8 @@
+#version 450
+// a triangle covering the screen, the fragment shader reads the fluid pass at every pixel
+
+void main()
+{
+	vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
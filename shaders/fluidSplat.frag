@@ -0,0 +1,39 @@
+#version 450
+// the impostor spheres of particleImpostor.vert traced into the offscreen attachments of the fluid pass.
+// the depth draw keeps the nearest sphere, the thickness draw adds up every sphere a pixel looks through
+
+layout (location = 0) in vec3 inViewPos;
+layout (location = 1) flat in vec3 inViewCenter;
+layout (location = 2) flat in vec3 inColor;
+
+layout (location = 0) out float outDepth;     // view depth of the hit, 0 is no fluid
+layout (location = 1) out float outThickness; // length of the ray inside the sphere
+layout (depth_greater) out float gl_FragDepth;
+
+layout( set = 0, binding = 0 ) uniform CameraBuffer
+{
+	mat4 proj;
+	mat4 view;
+	mat4 model;
+} cameraData;
+
+layout(push_constant) uniform PushConstants {
+	float radius;
+} pushConstants;
+
+void main()
+{
+	vec3 dir = normalize(inViewPos);
+	float b = dot(dir, inViewCenter);
+	float h = b * b - dot(inViewCenter, inViewCenter) + pushConstants.radius * pushConstants.radius;
+	if (h < 0.0)
+		discard;
+
+	float root = sqrt(h);
+	vec3 hit = dir * (b - root);
+	vec4 clip = cameraData.proj * vec4(hit, 1);
+	gl_FragDepth = clip.z / clip.w;
+
+	outDepth = -hit.z;
+	outThickness = 2.0 * root;
+}
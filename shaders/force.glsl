@@ -0,0 +1,197 @@
+// force.glsl
+#ifndef FORCE
+#define FORCE
+#include "header.glsl"
+#include "grid.glsl"
+#include "sphKernels.glsl"
+
+// pressure, viscosity, boundary and gravity force on one particle, shared by the force pass
+// and the fused force and integrate pass. include it after the local_size layout,
+// the tiles are sized by the workgroup
+
+// pressure and viscosity from one neighbor, caller checks it is in range
+void accumulateForce(vec3 rVec, float r, vec3 currentVelocity, float currentPressure,
+                     vec3 neighborVelocity, float density, inout vec3 pressureForce, inout vec3 viscosityForce)
+{
+    float pressure = stiffness * (density - restDensity);
+
+    // pressure force
+    vec3 kernelGrad = spikyKernelGradient(rVec, r);
+    pressureForce -= particleMass * ((currentPressure + pressure) / (2.0 * density) * kernelGrad);
+
+    float laplacian = viscosityKernelLaplacian(r);
+    viscosityForce += viscosity * particleMass * ((neighborVelocity - currentVelocity) / density) * laplacian;
+}
+
+layout(std430, binding = 0) readonly buffer positionBuffer {
+	vec4 positions[];
+} PositionData;
+
+layout(std430, binding = 1) readonly buffer velocityBuffer {
+	vec4 velocities[];
+} VelocityData;
+
+layout(std430, binding = 3) readonly buffer densityBuffer {
+	float densities[];
+} DensityData;
+
+// neighbor data staged by the whole workgroup for the tiled search
+shared vec4 tilePositions[THREADS_PER_GROUP];
+shared vec4 tileVelocities[THREADS_PER_GROUP];
+shared float tileDensities[THREADS_PER_GROUP];
+
+const float mirrorInfluenceScale = 0.8;
+
+// total force on the particle at global_id, the tiled search has barriers so every thread
+// of the workgroup has to call it, threads past the end pass active = false and get no force
+vec3 particleForce(uint global_id, bool active, vec3 currentPosition, vec3 currentVelocity, float currentDensity)
+{
+    float currentPressure = stiffness * (currentDensity - restDensity);
+    vec3 pressureForce = vec3(0.0), viscosityForce = vec3(0.0);
+    // compute pressure for particles
+    if (NEIGHBOR_SEARCH == SEARCH_GRID)
+    {
+        // only the 27 cells around this particle can be in range
+        ivec3 currentCell = cellCoord(currentPosition);
+        for (int z = -1; z <= 1; ++z)
+        for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+        {
+            ivec3 neighborCell = currentCell + ivec3(x, y, z);
+            if (!isCellInGrid(neighborCell)) continue;
+
+            uint cell = cellIndex(neighborCell);
+            uint cellBegin = CellData.cells[cell].start;
+            uint cellEnd = cellBegin + CellData.cells[cell].count;
+            for (uint j = cellBegin; j < cellEnd; ++j)
+            {
+                uint i = SortedIndexData.sortedIndices[j];
+                if(global_id == i) continue; // skip the current particle
+
+                vec3 rVec = currentPosition - PositionData.positions[i].xyz;
+                float r2;
+
+                // only fetch velocity and density of neighbors in range
+                if (inKernelRange(rVec, r2))
+                    accumulateForce(rVec, sqrt(r2), currentVelocity, currentPressure,
+                                    VelocityData.velocities[i].xyz, DensityData.densities[i], pressureForce, viscosityForce);
+            }
+        }
+    }
+    else if (NEIGHBOR_SEARCH == SEARCH_TILED)
+    {
+        // every thread loads one neighbor of the tile, then all threads read the tile from shared memory
+        for (uint tile = 0; tile < PARTICLE_COUNT; tile += THREADS_PER_GROUP)
+        {
+            uint load = min(tile + local_id, PARTICLE_COUNT - 1);
+            tilePositions[local_id] = PositionData.positions[load];
+            tileVelocities[local_id] = VelocityData.velocities[load];
+            tileDensities[local_id] = DensityData.densities[load];
+            barrier();
+
+            uint tileSize = min(uint(THREADS_PER_GROUP), PARTICLE_COUNT - tile);
+            for (uint k = 0; k < tileSize; ++k)
+            {
+                if(global_id == tile + k) continue; // skip the current particle
+
+                vec3 rVec = currentPosition - tilePositions[k].xyz;
+                float r2;
+
+                if (inKernelRange(rVec, r2))
+                    accumulateForce(rVec, sqrt(r2), currentVelocity, currentPressure,
+                                    tileVelocities[k].xyz, tileDensities[k], pressureForce, viscosityForce);
+            }
+            barrier();
+        }
+        if (!active) return vec3(0.0);
+    }
+    else
+    {
+        for(uint i = 0; i < PARTICLE_COUNT; ++i)
+        {
+            if(global_id == i) continue; // skip the current particle
+
+            vec3 rVec = currentPosition - PositionData.positions[i].xyz;
+            float r2;
+
+            if (inKernelRange(rVec, r2))
+                accumulateForce(rVec, sqrt(r2), currentVelocity, currentPressure,
+                                VelocityData.velocities[i].xyz, DensityData.densities[i], pressureForce, viscosityForce);
+        }
+    }
+    // Simulate mirror particles for each boundary
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float pos = currentPosition[axis];
+        float vel = currentVelocity[axis];
+        float minBoundary = domainMin[axis];
+        float maxBoundary = domainMax[axis];
+
+        // Check for proximity to min boundary
+        if (pos - minBoundary < smoothingLength)
+        {
+            // Mirror position and velocity
+            float mirrorPos = 2.0 * minBoundary - pos;
+            vec3 mirrorPosition = currentPosition;
+            mirrorPosition[axis] = mirrorPos;
+
+            vec3 mirrorVelocity = currentVelocity;
+            mirrorVelocity[axis] = -vel; // Reflect velocity component
+
+            vec3 rVec = currentPosition - mirrorPosition;
+            float r = length(rVec);
+
+            if (r > 0.0 && r <= smoothingLength)
+            {
+                // Set properties for mirror particle
+                float mirrorDensity = restDensity;    // Use rest density for static boundary
+                float mirrorPressure = 0.0;           // No pressure for static boundary
+
+                // Pressure force
+                vec3 kernelGrad = spikyKernelGradient(rVec, r);
+                pressureForce -= mirrorInfluenceScale * particleMass * ((currentPressure + mirrorPressure) / (2.0 * mirrorDensity)) * kernelGrad;
+
+                // Viscosity force
+                vec3 velDiff = mirrorVelocity - currentVelocity;
+                float laplacian = viscosityKernelLaplacian(r);
+                viscosityForce += mirrorInfluenceScale * viscosity * particleMass * (velDiff / mirrorDensity) * laplacian;
+            }
+        }
+
+        // Check for proximity to max boundary
+        if (maxBoundary - pos < smoothingLength)
+        {
+            // Mirror position and velocity
+            float mirrorPos = 2.0 * maxBoundary - pos;
+            vec3 mirrorPosition = currentPosition;
+            mirrorPosition[axis] = mirrorPos;
+
+            vec3 mirrorVelocity = currentVelocity;
+            mirrorVelocity[axis] = -vel; // Reflect velocity component
+
+            vec3 rVec = currentPosition - mirrorPosition;
+            float r = length(rVec);
+
+            if (r > 0.0 && r <= smoothingLength)
+            {
+                // Set properties for mirror particle
+                float mirrorDensity = restDensity;    // Use rest density for static boundary
+                float mirrorPressure = 0.0;           // No pressure for static boundary
+
+                // Pressure force
+                vec3 kernelGrad = spikyKernelGradient(rVec, r);
+                pressureForce -= mirrorInfluenceScale * particleMass * ((currentPressure + mirrorPressure) / (2.0 * mirrorDensity)) * kernelGrad;
+
+                // Viscosity force
+                vec3 velDiff = mirrorVelocity - currentVelocity;
+                float laplacian = viscosityKernelLaplacian(r);
+                viscosityForce += mirrorInfluenceScale * viscosity * particleMass * (velDiff / mirrorDensity) * laplacian;
+            }
+        }
+    }
+
+    vec3 gravistyForce = vec3(0.0, currentDensity * gravity, 0.0);
+    return pressureForce + viscosityForce + gravistyForce;
+}
+
+#endif
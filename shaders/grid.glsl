@@ -0,0 +1,50 @@
+// grid.glsl
+#ifndef GRID
+#define GRID
+#include "header.glsl"
+
+// uniform grid rebuilt every frame before the density pass
+// particles are counting sorted by cell, sortedIndices[cells[c].start .. cells[c].start + cells[c].count] are the particles in cell c
+struct GridCell
+{
+    uint count;
+    uint start;
+};
+
+struct ParticleCell
+{
+    uint cell;   // cell the particle belongs to
+    uint offset; // slot of the particle inside its cell
+};
+
+layout(std430, binding = 4) buffer cellBuffer {
+    GridCell cells[];
+} CellData;
+
+layout(std430, binding = 5) buffer particleCellBuffer {
+    ParticleCell particleCells[];
+} ParticleCellData;
+
+layout(std430, binding = 6) buffer sortedIndexBuffer {
+    uint sortedIndices[];
+} SortedIndexData;
+
+// particles outside the domain are clamped to the border cells, clamping keeps
+// two particles closer than the cell size in the same or adjacent cells
+ivec3 cellCoord(vec3 position)
+{
+    ivec3 coord = ivec3(floor((position - domainMin) / smoothingLength));
+    return clamp(coord, ivec3(0), ivec3(GRID_DIM - 1));
+}
+
+uint cellIndex(ivec3 coord)
+{
+    return uint((coord.z * GRID_DIM + coord.y) * GRID_DIM + coord.x);
+}
+
+bool isCellInGrid(ivec3 coord)
+{
+    return all(greaterThanEqual(coord, ivec3(0))) && all(lessThan(coord, ivec3(GRID_DIM)));
+}
+
+#endif
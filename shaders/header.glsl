@@ -2,28 +2,52 @@
 #ifndef HEADER
 #define HEADER
 
-struct Particle
-{
-    vec4 pos;
-    vec4 velocity;
-    vec4 force;
-    float density;
-    float pad[3];
-};
+// particles are stored as structure of arrays, one storage buffer per attribute
+// so each pass only binds what it touches. compute set bindings:
+// 0 positions, 1 velocities, 2 forces, 3 densities,
+// 4 grid cells, 5 particle cells, 6 sorted indices,
+// 7 sorted positions, 8 sorted velocities (other half of the ping-pong pair, also written by the fused force and integrate pass)
+// 9 render positions, 10 render velocities (copy for the frame being drawn)
+// 11 adaptive time step state, 12 PBF lambdas or DFSPH stiffness, 13 DFSPH alpha factors, 14 DFSPH solver state
+// PBF keeps its position corrections in the force buffer, DFSPH its predicted velocities
 // add bounding box here
-float boxSize = 6;
-vec3 domainMax = vec3(boxSize);
-vec3 domainMin = vec3(-boxSize);
-// if only change this, remember manually recompile shaders
+const float boxSize = 6.0;
+const vec3 domainMax = vec3(boxSize);
+const vec3 domainMin = vec3(-boxSize);
 
-const int MAX_INSTANCE = 1024*32;
-const int THREADS_PER_GROUP = 256;
+// specialization constants, set from SimulationParameters when the pipelines are created
+// so the scene size can change without recompiling, values here are only the defaults
+// constant ids must match SimulationParameters.h, the kernel constants 10 - 13 are in sphKernels.glsl,
+// the PBF ones 15 and 17 in pbf.glsl and the DFSPH ones 18 and 19 in dfsph.glsl
+layout(constant_id = 1) const uint PARTICLE_COUNT = 1024 * 32;
+// workgroup size is constant id 2, compute shaders declare layout(local_size_x_id = 2) in;
+#define THREADS_PER_GROUP gl_WorkGroupSize.x
 // SPH parameters
 const float particleMass = 1.2;           // Mass of each particle
-const float smoothingLength = 0.98;        // Smoothing length (h)
-const float stiffness = 120.0;           // Gas stiffness constant (k)
-const float restDensity = 980.0;         // Rest density of the fluid (ρ₀)
-const float viscosity = 0.7;              // Viscosity coefficient
+layout(constant_id = 3) const float smoothingLength = 0.98;        // Smoothing length (h)
+layout(constant_id = 4) const float stiffness = 120.0;           // Gas stiffness constant (k)
+layout(constant_id = 5) const float restDensity = 980.0;         // Rest density of the fluid (ρ₀)
+layout(constant_id = 6) const float viscosity = 0.7;              // Viscosity coefficient
 const float gravity = -9.81;               // Gravity constant
+// PBF and DFSPH, restDensity only works with the pressure offset of the SPH passes
+layout(constant_id = 14) const float incompressibleRestDensity = 65.0;
+layout(constant_id = 16) const float xsphViscosity = 0.01;     // velocity smoothing of PBF and DFSPH
+
+// adaptive time step, the pushed dt is then only the upper bound
+layout(constant_id = 8) const bool ADAPTIVE_TIME_STEP = false;
+layout(constant_id = 9) const float cflFactor = 0.4;            // share of the smoothing length a particle may travel per step
+
+// how density and force pass find neighbors, picked when the pipelines are created
+// all pairs is the exact brute force reference, tiled is the same loop staged through shared memory
+const int SEARCH_ALL_PAIRS = 0;
+const int SEARCH_TILED = 1;
+const int SEARCH_GRID = 2;
+layout(constant_id = 0) const int NEIGHBOR_SEARCH = SEARCH_GRID;
+
+// uniform grid for neighbor search, cell size equals the smoothing length
+// so all neighbors of a particle are inside the 27 cells around it
+// cells per axis is int(2 * boxSize / smoothingLength) + 1, computed on the host
+layout(constant_id = 7) const int GRID_DIM = 13;
+const int GRID_CELL_COUNT = GRID_DIM * GRID_DIM * GRID_DIM;
 
 #endif
\ No newline at end of file
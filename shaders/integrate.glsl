@@ -0,0 +1,87 @@
+// integrate.glsl
+#ifndef INTEGRATE
+#define INTEGRATE
+#include "header.glsl"
+
+const float restitutionCoefficient = 0.2;
+
+// explicit euler step, particles leaving the box bounce back from the wall they hit
+// shared by the position pass and the fused force and integrate pass
+void integrate(inout vec3 position, inout vec4 velocity, vec4 acceleration, float dt)
+{
+    velocity += acceleration * dt;
+    vec3 predictedPosition = velocity.xyz * dt + position;
+
+    // Handle collisions with boundaries on each axis
+    for (int axis = 0; axis < 3; ++axis) {
+        float pos = position[axis];
+        float vel = velocity[axis];
+        float minBoundary = domainMin[axis];
+        float maxBoundary = domainMax[axis];
+
+        // Check for collision with lower boundary
+        if (predictedPosition[axis] < minBoundary) {
+            // Time to collision
+            float timeCollision = (minBoundary - pos) / vel;
+
+            if (timeCollision >= 0.0 && timeCollision <= dt) {
+                // Update position to collision point
+                pos += vel * timeCollision;
+
+                // Reflect velocity
+                vel = -vel * restitutionCoefficient;
+
+                // Remaining time after collision
+                float dtRemaining = dt - timeCollision;
+
+                // Update position after collision
+                pos += vel * dtRemaining;
+
+                // Correct for any penetration due to numerical errors
+                if (pos < minBoundary) {
+                    pos = minBoundary + (minBoundary - pos);
+                }
+            } else {
+                // No collision within time step
+                pos = predictedPosition[axis];
+            }
+        }
+        // Check for collision with upper boundary
+        else if (predictedPosition[axis] > maxBoundary) {
+            // Time to collision
+            float timeCollision = (maxBoundary - pos) / vel;
+
+            if (timeCollision >= 0.0 && timeCollision <= dt) {
+                // Update position to collision point
+                pos += vel * timeCollision;
+
+                // Reflect velocity
+                vel = -vel * restitutionCoefficient;
+
+                // Remaining time after collision
+                float dtRemaining = dt - timeCollision;
+
+                // Update position after collision
+                pos += vel * dtRemaining;
+
+                // Correct for any penetration due to numerical errors
+                if (pos > maxBoundary) {
+                    pos = maxBoundary - (pos - maxBoundary);
+                }
+            } else {
+                // No collision within time step
+                pos = predictedPosition[axis];
+            }
+        }
+        // No collision
+        else {
+            pos = predictedPosition[axis];
+        }
+
+        // Update position and velocity arrays
+        position[axis] = pos;
+        velocity[axis] = vel;
+    }
+}
+
+#endif
@@ -0,0 +1,42 @@
+#version 450
+// ray traced sphere inside the quad of particleImpostor.vert, writes the depth and shades
+// with the normal of the hit so the impostors intersect each other like real spheres
+
+layout (location = 0) in vec3 inViewPos;
+layout (location = 1) flat in vec3 inViewCenter;
+layout (location = 2) flat in vec3 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+// the quad is in front of the sphere, hits are never closer than it
+layout (depth_greater) out float gl_FragDepth;
+
+layout( set = 0, binding = 0 ) uniform CameraBuffer
+{
+	mat4 proj;
+	mat4 view;
+	mat4 model;
+} cameraData;
+
+layout(push_constant) uniform PushConstants {
+	float radius;
+} pushConstants;
+
+void main()
+{
+	// the camera is the origin of view space
+	vec3 dir = normalize(inViewPos);
+	float b = dot(dir, inViewCenter);
+	float h = b * b - dot(inViewCenter, inViewCenter) + pushConstants.radius * pushConstants.radius;
+	if (h < 0.0)
+		discard;
+
+	vec3 hit = dir * (b - sqrt(h));
+	vec3 normal = (hit - inViewCenter) / pushConstants.radius;
+
+	vec4 clip = cameraData.proj * vec4(hit, 1);
+	gl_FragDepth = clip.z / clip.w;
+
+	// light from the camera, the mesh spheres are unlit so keep the rim from going black
+	float light = 0.35 + 0.65 * max(dot(normal, -dir), 0.0);
+	outFragColor = vec4(inColor * light, 1.0f);
+}
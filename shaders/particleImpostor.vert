@@ -0,0 +1,68 @@
+#version 450
+// one camera facing quad per particle, no vertex buffer, six vertices per visible particle
+// drawn indirectly with the count cullParticles.comp wrote. the fragment shader traces the sphere inside it
+
+layout (location = 0) out vec3 outViewPos;         // where the quad is, the ray goes through it
+layout (location = 1) flat out vec3 outViewCenter;
+layout (location = 2) flat out vec3 outColor;
+
+layout( set = 0, binding = 0 ) uniform CameraBuffer
+{
+	mat4 proj;
+	mat4 view;
+	mat4 model;
+} cameraData;
+
+layout(std430, binding = 1) readonly buffer positionBuffer {
+	vec4 positions[];
+} PositionData;
+
+layout(std430, binding = 2) readonly buffer velocityBuffer {
+	vec4 velocities[];
+} VelocityData;
+
+layout(std430, binding = 3) readonly buffer visibleBuffer {
+	uint indices[];
+} VisibleData;
+
+layout(push_constant) uniform PushConstants {
+	float radius; // of the mesh sphere, so both renderers look the same
+} pushConstants;
+
+// two triangles, corners in units of the half size
+const vec2 corners[6] = vec2[](vec2(-1, -1), vec2(1, -1), vec2(1, 1), vec2(-1, -1), vec2(1, 1), vec2(-1, 1));
+
+void main()
+{
+	uint particle = VisibleData.indices[gl_VertexIndex / 6];
+	vec2 corner = corners[gl_VertexIndex % 6];
+	float r = pushConstants.radius;
+
+	vec3 center = (cameraData.view * vec4(PositionData.positions[particle].xyz, 1)).xyz;
+	float z2 = center.z * center.z - r * r;
+	// the camera is inside or right next to it, nothing sensible to draw
+	if (center.z > -r || z2 <= 0.0)
+	{
+		gl_Position = vec4(0, 0, 2, 1); // outside the clip volume
+		return;
+	}
+
+	// the quad sits on the plane touching the front of the sphere, so every point the fragment shader
+	// finds is behind it and the depth only ever grows (depth_greater keeps early depth testing).
+	// on that plane the projected sphere is an ellipse around the projected center, shifted outward,
+	// the half size covers its major axis and the shift
+	float planeDepth = -(center.z + r);
+	float scale = planeDepth / -center.z;
+	float distance2 = dot(center, center);
+	float majorAxis = r * sqrt(distance2 - r * r) / z2;
+	float shift = length(center.xy) * r * r / (-center.z * z2);
+	float halfSize = planeDepth * (majorAxis + shift);
+
+	vec3 viewPos = vec3(center.xy * scale + corner * halfSize, -planeDepth);
+	outViewPos = viewPos;
+	outViewCenter = center;
+	gl_Position = cameraData.proj * vec4(viewPos, 1);
+
+	float t = length(VelocityData.velocities[particle]) / 30.f;
+	outColor = mix(vec3(0,0,1), vec3(1,1,1), t);
+}
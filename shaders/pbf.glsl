@@ -0,0 +1,30 @@
+// pbf.glsl
+#ifndef PBF
+#define PBF
+#include "header.glsl"
+#include "sphKernels.glsl"
+
+// position based fluids, the density constraint rho_i / rho_0 - 1 = 0 is solved by a few
+// Jacobi iterations on predicted positions. while a step runs binding 0 holds the predicted
+// positions and binding 7 the positions the step started from, neighbors always come from the grid
+layout(constant_id = 15) const float pbfRelaxation = 0.1;      // constraint force mixing, keeps lambda finite for particles with few neighbors
+layout(constant_id = 17) const float tensileCorrection = 0.1;  // k of the artificial pressure against clumping
+
+// scaling factor of the constraint, one per particle
+layout(std430, binding = 12) buffer lambdaBuffer {
+    float lambdas[];
+} LambdaData;
+
+// the walls are plain position constraints
+vec3 clampToDomain(vec3 position)
+{
+    return clamp(position, domainMin, domainMax);
+}
+
+// m / rho_0, how much of the volume around a particle one neighbor stands for
+float pbfParticleVolume()
+{
+    return particleMass / incompressibleRestDensity;
+}
+
+#endif
@@ -0,0 +1,41 @@
+// sphKernels.glsl
+#ifndef SPH_KERNELS
+#define SPH_KERNELS
+#include "header.glsl"
+
+// SPH smoothing kernels in polynomial form. the normalization constants are computed once
+// on the host (SimulationParameters.h) and come in as specialization constants,
+// so a pair in the neighbor loops costs multiplies only. the CPU solver uses the same constants
+layout(constant_id = 10) const float smoothingLengthSquared = 0.9604;
+layout(constant_id = 11) const float poly6Coefficient = 1.8790833;      // 315 / (64 pi h^9)
+layout(constant_id = 12) const float spikyCoefficient = -16.169857;     // -45 / (pi h^6)
+layout(constant_id = 13) const float viscosityCoefficient = 16.169857;  // 45 / (pi h^6)
+
+// squared distance test, pairs out of range never pay for the square root
+bool inKernelRange(vec3 rVec, out float r2)
+{
+    r2 = dot(rVec, rVec);
+    return r2 <= smoothingLengthSquared;
+}
+
+// Poly6 kernel for density estimation, takes the squared distance
+float poly6Kernel(float r2)
+{
+    float hr2 = smoothingLengthSquared - r2;
+    return poly6Coefficient * (hr2 * hr2 * hr2);
+}
+
+// Spiky kernel gradient for pressure force, r is length(rVec)
+vec3 spikyKernelGradient(vec3 rVec, float r)
+{
+    float hr = smoothingLength - r;
+    return spikyCoefficient * (hr * hr) * (rVec / r);
+}
+
+// Viscosity kernel Laplacian for viscosity force
+float viscosityKernelLaplacian(float r)
+{
+    return viscosityCoefficient * (smoothingLength - r);
+}
+
+#endif
@@ -0,0 +1,20 @@
+#version 450
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inViewPos;
+
+layout (location = 0) out vec4 outFragColor;
+
+// light from the camera and a rim towards grazing angles, both sides of the surface are drawn
+void main()
+{
+	vec3 normal = normalize(inNormal);
+	vec3 toCamera = normalize(-inViewPos);
+	if (dot(normal, toCamera) < 0.0)
+		normal = -normal;
+
+	float diffuse = max(dot(normal, toCamera), 0.0);
+	float rim = pow(1.0 - diffuse, 3.0);
+	vec3 water = vec3(0.1, 0.35, 0.8);
+	outFragColor = vec4(water * (0.3 + 0.7 * diffuse) + vec3(rim * 0.5), 1.0);
+}
@@ -0,0 +1,120 @@
+// surface.glsl
+#ifndef SURFACE
+#define SURFACE
+#include "header.glsl"
+
+// water surface reconstruction on the graphics queue, bindings of the surface set:
+// 0 camera, 1 render positions, 2 density field, 3 vertex count of every cell,
+// 4 vertex count and then offset of every workgroup of cells, 5 triangle table,
+// 6 surface vertices, 7 indirect draw command
+// the field has resolution nodes per axis spread over the domain, a cell has eight nodes as corners
+
+layout(std430, binding = 1) readonly buffer positionBuffer {
+	vec4 positions[];
+} PositionData;
+
+// fixed point, the splat adds with integer atomics
+layout(std430, binding = 2) buffer fieldBuffer {
+	uint values[];
+} FieldData;
+
+layout(std430, binding = 3) buffer cellCountBuffer {
+	uint counts[];
+} CellCountData;
+
+layout(std430, binding = 4) buffer blockBuffer {
+	uint sums[];
+} BlockData;
+
+// MarchingCubes.h, sixteen entries per case
+layout(std430, binding = 5) readonly buffer tableBuffer {
+	int triangles[];
+} TableData;
+
+struct SurfaceVertex
+{
+	vec4 position;
+	vec4 normal;
+};
+
+layout(std430, binding = 6) buffer vertexBuffer {
+	SurfaceVertex vertices[];
+} VertexData;
+
+// a VkDrawIndirectCommand
+layout(std430, binding = 7) buffer drawCommandBuffer {
+	uint vertexCount;
+	uint instanceCount;
+	uint firstVertex;
+	uint firstInstance;
+} DrawCommand;
+
+// SurfacePushConstants in Mesh.h
+layout(push_constant) uniform PushConstants {
+	uint resolution;     // nodes per axis
+	uint particleCount;
+	uint maxVertices;    // what the vertex buffer holds, triangles past it are dropped
+	float nodeSpacing;
+	float radius;        // of the splat kernel
+	float isoLevel;      // field value of the surface, a particle alone reaches 1 at its center
+} pushConstants;
+
+// fixed point scale of the field
+const float FIELD_SCALE = 256.0;
+
+#define SURFACE_GROUP_SIZE 256
+
+uint nodeIndex(ivec3 node)
+{
+	int resolution = int(pushConstants.resolution);
+	return uint((node.z * resolution + node.y) * resolution + node.x);
+}
+
+float fieldValue(ivec3 node)
+{
+	node = clamp(node, ivec3(0), ivec3(int(pushConstants.resolution) - 1));
+	return float(FieldData.values[nodeIndex(node)]) / FIELD_SCALE;
+}
+
+vec3 nodePosition(ivec3 node)
+{
+	return domainMin + vec3(node) * pushConstants.nodeSpacing;
+}
+
+uint cellCount()
+{
+	uint cells = pushConstants.resolution - 1;
+	return cells * cells * cells;
+}
+
+ivec3 cellCoord(uint cell)
+{
+	int cells = int(pushConstants.resolution) - 1;
+	return ivec3(int(cell) % cells, (int(cell) / cells) % cells, int(cell) / (cells * cells));
+}
+
+// corner i of a cell, numbered like MarchingCubes.cpp
+const ivec3 CORNER_OFFSETS[8] = ivec3[](ivec3(0, 0, 0), ivec3(1, 0, 0), ivec3(1, 1, 0), ivec3(0, 1, 0),
+										 ivec3(0, 0, 1), ivec3(1, 0, 1), ivec3(1, 1, 1), ivec3(0, 1, 1));
+
+// bit i set when corner i is inside, above the iso level
+uint cubeIndex(ivec3 cell)
+{
+	uint index = 0u;
+	for (int i = 0; i < 8; i++)
+	{
+		if (fieldValue(cell + CORNER_OFFSETS[i]) > pushConstants.isoLevel)
+			index |= 1u << i;
+	}
+	return index;
+}
+
+uint triangleVertexCount(uint cubeIndex)
+{
+	uint count = 0u;
+	while (count < 15u && TableData.triangles[cubeIndex * 16u + count] >= 0)
+		count++;
+	return count;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+#include "surface.glsl"
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outViewPos;
+
+layout( set = 0, binding = 0 ) uniform CameraBuffer
+{
+	mat4 proj;
+	mat4 view;
+	mat4 model;
+} cameraData;
+
+// the triangles surfaceGenerate.comp wrote, drawn indirectly with the count of the scan
+void main()
+{
+	SurfaceVertex vertex = VertexData.vertices[gl_VertexIndex];
+	vec4 viewPos = cameraData.view * vertex.position;
+	outViewPos = viewPos.xyz;
+	outNormal = mat3(cameraData.view) * vertex.normal.xyz;
+	gl_Position = cameraData.proj * viewPos;
+}
@@ -0,0 +1,39 @@
+// timeStep.glsl
+#ifndef TIME_STEP
+#define TIME_STEP
+#include "header.glsl"
+
+// adaptive time step, the reduction pass after the force pass fills in the maxima
+// and the position pass turns them into the step it integrates with
+// maxima are stored as float bits, the order of non negative floats matches their bits as uint so atomicMax works
+struct TimeStepState
+{
+    uint maxSpeed;
+    uint maxAcceleration;
+    float dt;   // step the last position pass took
+    float time; // simulated time since the last reset
+};
+
+layout(std430, binding = 11) buffer timeStepBuffer {
+    TimeStepState state;
+} TimeStepData;
+
+// share of the smoothing length a particle may travel in one step is cflFactor,
+// the acceleration bound is the usual force criterion
+const float forceTimeStepFactor = 0.25;
+
+// largest step that keeps the fastest and the most accelerated particle stable, never above maxDt
+float adaptiveTimeStep(float maxDt)
+{
+    float maxSpeed = uintBitsToFloat(TimeStepData.state.maxSpeed);
+    float maxAcceleration = uintBitsToFloat(TimeStepData.state.maxAcceleration);
+
+    float dt = maxDt;
+    if (maxSpeed > 0.0)
+        dt = min(dt, cflFactor * smoothingLength / maxSpeed);
+    if (maxAcceleration > 0.0)
+        dt = min(dt, forceTimeStepFactor * sqrt(smoothingLength / maxAcceleration));
+    return dt;
+}
+
+#endif
@@ -15,15 +15,25 @@ layout( set = 0, binding = 0 ) uniform CameraBuffer
 	mat4 model;
 } cameraData;
 
-layout(std430, binding = 1) buffer storageBuffer {
-	Particle particles[MAX_INSTANCE];
-} ObjectData;
+layout(std430, binding = 1) readonly buffer positionBuffer {
+	vec4 positions[];
+} PositionData;
+
+layout(std430, binding = 2) readonly buffer velocityBuffer {
+	vec4 velocities[];
+} VelocityData;
+
+// written by cullParticles.comp, an instance per visible particle
+layout(std430, binding = 3) readonly buffer visibleBuffer {
+	uint indices[];
+} VisibleData;
 
 void main()
 {
-	vec4 pos = ObjectData.particles[gl_InstanceIndex].pos + cameraData.model * vec4(vPosition, 1);
+	uint particle = VisibleData.indices[gl_InstanceIndex];
+	vec4 pos = PositionData.positions[particle] + cameraData.model * vec4(vPosition, 1);
 	gl_Position = cameraData.proj * cameraData.view * pos;
-	float length = length(ObjectData.particles[gl_InstanceIndex].velocity);
+	float length = length(VelocityData.velocities[particle]);
 	float t = 0;
     t = length / 30.f;
 	outColor = mix(vec3(0,0,1), vec3(1,1,1), t);
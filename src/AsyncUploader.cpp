@@ -0,0 +1,192 @@
+#include "AsyncUploader.h"
+#include "Defines.h"
+#include "vk_initializers.h"
+#include <cstring>
+#include <algorithm>
+
+void AsyncUploader::init(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queueFamily)
+{
+	this->device = device;
+	this->allocator = allocator;
+	this->queue = queue;
+	this->queueFamily = queueFamily;
+	lastSignalValue = 0;
+
+	// command buffers are freed one by one once their submit is done
+	VkCommandPoolCreateInfo commandPoolInfo = vkinit::commandPoolCreateInfo(queueFamily, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+	VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commandPool));
+
+	VkSemaphoreTypeCreateInfo timelineCreateInfo = {};
+	timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineCreateInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &timelineCreateInfo;
+	VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &timeline));
+}
+
+void AsyncUploader::cleanUp()
+{
+	if (commandPool == VK_NULL_HANDLE)
+		return;
+
+	// nothing may still read the staging buffers
+	if (lastSignalValue > 0)
+	{
+		VkSemaphoreWaitInfo waitInfo = {};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &timeline;
+		waitInfo.pValues = &lastSignalValue;
+		VK_CHECK(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+	}
+	collect();
+
+	for (QueuedCopy& copy : queued)
+		vmaDestroyBuffer(allocator, copy.staging.buffer, copy.staging.allocation);
+	queued.clear();
+	acquires.clear();
+
+	vkDestroyCommandPool(device, commandPool, nullptr);
+	vkDestroySemaphore(device, timeline, nullptr);
+	commandPool = VK_NULL_HANDLE;
+	timeline = VK_NULL_HANDLE;
+}
+
+void AsyncUploader::upload(const void* data, VkDeviceSize size, VkBuffer dst, uint32_t dstFamily, VkDeviceSize dstOffset)
+{
+	if (size == 0)
+		return;
+
+	// a buffer per upload, they are rare and large so a ring would have to be as big as the largest
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	QueuedCopy copy;
+	VmaAllocationInfo allocationInfo;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &copy.staging.buffer, &copy.staging.allocation, &allocationInfo));
+	memcpy(allocationInfo.pMappedData, data, size);
+	VK_CHECK(vmaFlushAllocation(allocator, copy.staging.allocation, 0, size));
+
+	copy.dst = dst;
+	copy.region = { 0, dstOffset, size };
+	copy.dstFamily = dstFamily;
+	queued.push_back(copy);
+}
+
+uint64_t AsyncUploader::submit()
+{
+	if (queued.empty())
+		return lastSignalValue;
+
+	Batch batch;
+	batch.value = ++lastSignalValue;
+	VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::commandBufferAllocateInfo(commandPool, 1);
+	VK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, &batch.cmd));
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK(vkBeginCommandBuffer(batch.cmd, &beginInfo));
+
+	std::vector<VkBufferMemoryBarrier> releases;
+	for (const QueuedCopy& copy : queued)
+	{
+		vkCmdCopyBuffer(batch.cmd, copy.staging.buffer, copy.dst, 1, &copy.region);
+		batch.stagingBuffers.push_back(copy.staging);
+
+		// the release half of the ownership transfer, the destination queue records the same barrier as acquire
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = queueFamily;
+		barrier.dstQueueFamilyIndex = copy.dstFamily;
+		barrier.buffer = copy.dst;
+		barrier.offset = copy.region.dstOffset;
+		barrier.size = copy.region.size;
+		releases.push_back(barrier);
+
+		Acquire acquire;
+		acquire.value = batch.value;
+		acquire.family = copy.dstFamily;
+		acquire.barrier = barrier;
+		acquire.barrier.srcAccessMask = 0;
+		acquire.barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		acquires.push_back(acquire);
+	}
+	queued.clear();
+
+	vkCmdPipelineBarrier(batch.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+						 static_cast<uint32_t>(releases.size()), releases.data(), 0, nullptr);
+	VK_CHECK(vkEndCommandBuffer(batch.cmd));
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &batch.value;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch.cmd;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &timeline;
+	VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+	inFlight.push_back(batch);
+	return batch.value;
+}
+
+uint64_t AsyncUploader::recordAcquire(VkCommandBuffer cmd, uint32_t family)
+{
+	uint64_t waitValue = 0;
+	std::vector<VkBufferMemoryBarrier> barriers;
+	for (auto it = acquires.begin(); it != acquires.end();)
+	{
+		if (it->family != family)
+		{
+			++it;
+			continue;
+		}
+		waitValue = std::max(waitValue, it->value);
+		barriers.push_back(it->barrier);
+		it = acquires.erase(it);
+	}
+
+	// the semaphore wait already orders it after the release
+	if (!barriers.empty())
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr,
+							 static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+	return waitValue;
+}
+
+void AsyncUploader::collect()
+{
+	if (inFlight.empty())
+		return;
+
+	uint64_t completed = 0;
+	VK_CHECK(vkGetSemaphoreCounterValue(device, timeline, &completed));
+	for (auto it = inFlight.begin(); it != inFlight.end();)
+	{
+		if (it->value > completed)
+		{
+			++it;
+			continue;
+		}
+		for (AllocatedBuffer& staging : it->stagingBuffers)
+			vmaDestroyBuffer(allocator, staging.buffer, staging.allocation);
+		vkFreeCommandBuffers(device, commandPool, 1, &it->cmd);
+		it = inFlight.erase(it);
+	}
+}
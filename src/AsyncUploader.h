@@ -0,0 +1,66 @@
+#pragma once
+#include <vk_types.h>
+#include <vector>
+
+// uploads on the dedicated transfer queue, so large copies never occupy the graphics or compute queue.
+// every submit signals the next value of a timeline semaphore, the queue family a buffer is meant for
+// takes ownership of it with an acquire barrier in its next submit and waits on that value first.
+// the destinations must not be in use on another queue, like buffers that were just created
+class AsyncUploader
+{
+public:
+	void init(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queueFamily);
+	void cleanUp();
+
+	// copy data into a staging buffer of its own and queue the copy into dst for the queue family dstFamily
+	void upload(const void* data, VkDeviceSize size, VkBuffer dst, uint32_t dstFamily, VkDeviceSize dstOffset = 0);
+	// submit the queued copies with the release barriers, returns the timeline value they signal
+	uint64_t submit();
+	bool hasQueued() const { return !queued.empty(); }
+
+	// record the acquire barriers of the submitted uploads meant for family at the start of cmd.
+	// returns the timeline value the submit of cmd has to wait on, 0 when there is nothing to acquire
+	uint64_t recordAcquire(VkCommandBuffer cmd, uint32_t family);
+	// free the staging buffers and command buffers of the submits the transfer queue is done with
+	void collect();
+
+	VkSemaphore getTimeline() const { return timeline; }
+	uint32_t getQueueFamily() const { return queueFamily; }
+
+private:
+	struct QueuedCopy
+	{
+		AllocatedBuffer staging;
+		VkBuffer dst;
+		VkBufferCopy region;
+		uint32_t dstFamily;
+	};
+
+	// one submit, freed once the timeline reaches value
+	struct Batch
+	{
+		uint64_t value;
+		VkCommandBuffer cmd;
+		std::vector<AllocatedBuffer> stagingBuffers;
+	};
+
+	// the second half of an ownership transfer, recorded by the destination queue
+	struct Acquire
+	{
+		uint64_t value;
+		uint32_t family;
+		VkBufferMemoryBarrier barrier;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VmaAllocator allocator = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t queueFamily = 0;
+	VkCommandPool commandPool = VK_NULL_HANDLE;
+	VkSemaphore timeline = VK_NULL_HANDLE;
+	uint64_t lastSignalValue = 0;
+
+	std::vector<QueuedCopy> queued;
+	std::vector<Batch> inFlight;
+	std::vector<Acquire> acquires;
+};
@@ -0,0 +1,532 @@
+#include "CpuSolver.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CPU_SOLVER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_SOLVER_SSE
+#endif
+
+namespace
+{
+	const float MIRROR_INFLUENCE_SCALE = 0.8f;  // forceCompute.comp
+	const float RESTITUTION_COEFFICIENT = 0.2f; // positionCompute.comp
+
+	// thin wrappers so the neighbor loops are written once for both instruction sets
+#if defined(CPU_SOLVER_AVX2)
+	typedef __m256 Lane;
+	const uint32_t LANE_WIDTH = 8;
+
+	inline Lane laneSet(float v) { return _mm256_set1_ps(v); }
+	inline Lane laneLoad(const float* p) { return _mm256_loadu_ps(p); }
+	inline Lane laneAdd(Lane a, Lane b) { return _mm256_add_ps(a, b); }
+	inline Lane laneSub(Lane a, Lane b) { return _mm256_sub_ps(a, b); }
+	inline Lane laneMul(Lane a, Lane b) { return _mm256_mul_ps(a, b); }
+	inline Lane laneDiv(Lane a, Lane b) { return _mm256_div_ps(a, b); }
+	inline Lane laneSqrt(Lane a) { return _mm256_sqrt_ps(a); }
+	inline Lane laneAnd(Lane mask, Lane a) { return _mm256_and_ps(mask, a); }
+	inline Lane laneLessEqual(Lane a, Lane b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+
+	// lanes whose slot is not self, slots are first .. first + 7
+	inline Lane laneNotSelf(uint32_t first, uint32_t self)
+	{
+		__m256i slots = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(first)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256i isSelf = _mm256_cmpeq_epi32(slots, _mm256_set1_epi32(static_cast<int>(self)));
+		return _mm256_castsi256_ps(_mm256_xor_si256(isSelf, _mm256_set1_epi32(-1)));
+	}
+
+	inline float laneSum(Lane v)
+	{
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+	}
+#define CPU_SOLVER_SIMD
+#elif defined(CPU_SOLVER_SSE)
+	typedef __m128 Lane;
+	const uint32_t LANE_WIDTH = 4;
+
+	inline Lane laneSet(float v) { return _mm_set1_ps(v); }
+	inline Lane laneLoad(const float* p) { return _mm_loadu_ps(p); }
+	inline Lane laneAdd(Lane a, Lane b) { return _mm_add_ps(a, b); }
+	inline Lane laneSub(Lane a, Lane b) { return _mm_sub_ps(a, b); }
+	inline Lane laneMul(Lane a, Lane b) { return _mm_mul_ps(a, b); }
+	inline Lane laneDiv(Lane a, Lane b) { return _mm_div_ps(a, b); }
+	inline Lane laneSqrt(Lane a) { return _mm_sqrt_ps(a); }
+	inline Lane laneAnd(Lane mask, Lane a) { return _mm_and_ps(mask, a); }
+	inline Lane laneLessEqual(Lane a, Lane b) { return _mm_cmple_ps(a, b); }
+
+	// lanes whose slot is not self, slots are first .. first + 3
+	inline Lane laneNotSelf(uint32_t first, uint32_t self)
+	{
+		__m128i slots = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(first)), _mm_setr_epi32(0, 1, 2, 3));
+		__m128i isSelf = _mm_cmpeq_epi32(slots, _mm_set1_epi32(static_cast<int>(self)));
+		return _mm_castsi128_ps(_mm_xor_si128(isSelf, _mm_set1_epi32(-1)));
+	}
+
+	inline float laneSum(Lane v)
+	{
+		__m128 sum = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+	}
+#define CPU_SOLVER_SIMD
+#endif
+}
+
+CpuSolver::CpuSolver(const SimulationParameters& params, unsigned threadCount) : params(params), pool(threadCount)
+{
+	gridDim = params.gridDim();
+	h = params.smoothingLength;
+	h2 = h * h;
+	// the constants the shaders are specialized with
+	poly6Coefficient = params.poly6Coefficient();
+	spikyCoefficient = params.spikyCoefficient();
+	viscosityCoefficient = params.viscosityCoefficient();
+
+	cellStart.resize(params.gridCellCount());
+	cellCount.resize(params.gridCellCount());
+}
+
+const char* CpuSolver::simdName()
+{
+#if defined(CPU_SOLVER_AVX2)
+	return "AVX2";
+#elif defined(CPU_SOLVER_SSE)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+void CpuSolver::setParticles(const std::vector<glm::vec4>& positions, const std::vector<glm::vec4>& velocities)
+{
+	count = static_cast<uint32_t>(positions.size());
+
+	for (std::vector<float>* attribute : { &px, &py, &pz, &vx, &vy, &vz, &fx, &fy, &fz, &density,
+										   &spx, &spy, &spz, &svx, &svy, &svz, &sdensity })
+		attribute->assign(count, 0.f);
+	particleCell.resize(count);
+	sortedIndices.resize(count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		px[i] = positions[i].x;
+		py[i] = positions[i].y;
+		pz[i] = positions[i].z;
+		vx[i] = velocities[i].x;
+		vy[i] = velocities[i].y;
+		vz[i] = velocities[i].z;
+	}
+}
+
+void CpuSolver::step(float dt)
+{
+	buildCellList();
+	computeDensity();
+	computeForce();
+	integrate(dt);
+}
+
+ParticleReadback CpuSolver::readback() const
+{
+	ParticleReadback readback;
+	readback.positions.resize(count);
+	readback.velocities.resize(count);
+	readback.densities = density;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		readback.positions[i] = glm::vec4(px[i], py[i], pz[i], 1.f);
+		readback.velocities[i] = glm::vec4(vx[i], vy[i], vz[i], 0.f);
+	}
+	return readback;
+}
+
+glm::ivec3 CpuSolver::cellCoord(float x, float y, float z) const
+{
+	// same as grid.glsl, particles outside the domain are clamped to the border cells
+	glm::ivec3 coord(static_cast<int>(std::floor((x + BOX_SIZE) / h)),
+					 static_cast<int>(std::floor((y + BOX_SIZE) / h)),
+					 static_cast<int>(std::floor((z + BOX_SIZE) / h)));
+	return glm::clamp(coord, glm::ivec3(0), glm::ivec3(gridDim - 1));
+}
+
+int CpuSolver::cellIndex(const glm::ivec3& coord) const
+{
+	return (coord.z * gridDim + coord.y) * gridDim + coord.x;
+}
+
+template<typename Function>
+void CpuSolver::forEachNeighborRange(const glm::ivec3& coord, Function function) const
+{
+	// only the 27 cells around the particle can be in range
+	for (int z = std::max(coord.z - 1, 0); z <= std::min(coord.z + 1, gridDim - 1); ++z)
+	for (int y = std::max(coord.y - 1, 0); y <= std::min(coord.y + 1, gridDim - 1); ++y)
+	for (int x = std::max(coord.x - 1, 0); x <= std::min(coord.x + 1, gridDim - 1); ++x)
+	{
+		int cell = cellIndex(glm::ivec3(x, y, z));
+		function(cellStart[cell], cellStart[cell] + cellCount[cell]);
+	}
+}
+
+void CpuSolver::buildCellList()
+{
+	pool.parallelFor(count, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			particleCell[i] = static_cast<uint32_t>(cellIndex(cellCoord(px[i], py[i], pz[i])));
+	});
+
+	// counting sort by cell, serial since it is a single pass over the particles
+	std::fill(cellCount.begin(), cellCount.end(), 0u);
+	for (uint32_t i = 0; i < count; i++)
+		cellCount[particleCell[i]]++;
+
+	uint32_t offset = 0;
+	for (size_t c = 0; c < cellCount.size(); c++)
+	{
+		cellStart[c] = offset;
+		offset += cellCount[c];
+	}
+
+	// cellCount is rebuilt as the running slot of each cell, then holds the count again
+	std::fill(cellCount.begin(), cellCount.end(), 0u);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t cell = particleCell[i];
+		sortedIndices[cellStart[cell] + cellCount[cell]++] = i;
+	}
+
+	pool.parallelFor(count, [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++)
+		{
+			uint32_t i = sortedIndices[s];
+			spx[s] = px[i];
+			spy[s] = py[i];
+			spz[s] = pz[i];
+			svx[s] = vx[i];
+			svy[s] = vy[i];
+			svz[s] = vz[i];
+		}
+	});
+}
+
+float CpuSolver::densitySum(float x, float y, float z, uint32_t begin, uint32_t end, uint32_t self) const
+{
+	float sum = 0.f;
+	uint32_t j = begin;
+
+#if defined(CPU_SOLVER_SIMD)
+	const Lane xs = laneSet(x), ys = laneSet(y), zs = laneSet(z);
+	const Lane h2s = laneSet(h2);
+	Lane sums = laneSet(0.f);
+	for (; j + LANE_WIDTH <= end; j += LANE_WIDTH)
+	{
+		Lane dx = laneSub(xs, laneLoad(&spx[j]));
+		Lane dy = laneSub(ys, laneLoad(&spy[j]));
+		Lane dz = laneSub(zs, laneLoad(&spz[j]));
+		Lane r2 = laneAdd(laneAdd(laneMul(dx, dx), laneMul(dy, dy)), laneMul(dz, dz));
+
+		Lane inRange = laneAnd(laneNotSelf(j, self), laneLessEqual(r2, h2s));
+		Lane hr2 = laneSub(h2s, r2);
+		sums = laneAdd(sums, laneAnd(inRange, laneMul(laneMul(hr2, hr2), hr2)));
+	}
+	sum += laneSum(sums);
+#endif
+
+	for (; j < end; ++j)
+	{
+		if (j == self) continue; // skip the current particle
+		float dx = x - spx[j], dy = y - spy[j], dz = z - spz[j];
+		float r2 = dx * dx + dy * dy + dz * dz;
+		if (r2 <= h2)
+		{
+			float hr2 = h2 - r2;
+			sum += hr2 * hr2 * hr2;
+		}
+	}
+
+	return sum * poly6Coefficient * PARTICLE_MASS;
+}
+
+void CpuSolver::computeDensity()
+{
+	pool.parallelFor(count, [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++)
+		{
+			float position[3] = { spx[s], spy[s], spz[s] };
+			uint32_t self = static_cast<uint32_t>(s);
+
+			float d = params.restDensity;
+			forEachNeighborRange(cellCoord(position[0], position[1], position[2]), [&](uint32_t cellBegin, uint32_t cellEnd) {
+				d += densitySum(position[0], position[1], position[2], cellBegin, cellEnd, self);
+			});
+
+			// mirror particles for each boundary, as in densityCompute.comp
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float pos = position[axis];
+				if (pos + BOX_SIZE < h)
+				{
+					float r = std::abs(2.f * (pos + BOX_SIZE));
+					if (r <= h)
+					{
+						float hr2 = h2 - r * r;
+						d += PARTICLE_MASS * poly6Coefficient * (hr2 * hr2 * hr2);
+					}
+				}
+				if (BOX_SIZE - pos < h)
+				{
+					float r = std::abs(2.f * (pos - BOX_SIZE));
+					if (r <= h)
+					{
+						float hr2 = h2 - r * r;
+						d += PARTICLE_MASS * poly6Coefficient * (hr2 * hr2 * hr2);
+					}
+				}
+			}
+
+			sdensity[s] = d;
+			density[sortedIndices[s]] = d;
+		}
+	});
+}
+
+void CpuSolver::forceSum(uint32_t s, uint32_t begin, uint32_t end, float pressure, float* pressureForce, float* viscosityForce) const
+{
+	const float x = spx[s], y = spy[s], z = spz[s];
+	const float velX = svx[s], velY = svy[s], velZ = svz[s];
+
+	// sums of the per neighbor terms, constant factors are applied at the end
+	float pressureSum[3] = { 0.f, 0.f, 0.f };
+	float viscositySum[3] = { 0.f, 0.f, 0.f };
+	uint32_t j = begin;
+
+#if defined(CPU_SOLVER_SIMD)
+	const Lane xs = laneSet(x), ys = laneSet(y), zs = laneSet(z);
+	const Lane velXs = laneSet(velX), velYs = laneSet(velY), velZs = laneSet(velZ);
+	const Lane hs = laneSet(h), h2s = laneSet(h2);
+	const Lane pressures = laneSet(pressure);
+	const Lane stiffnesses = laneSet(params.stiffness), restDensities = laneSet(params.restDensity);
+
+	Lane pressureX = laneSet(0.f), pressureY = laneSet(0.f), pressureZ = laneSet(0.f);
+	Lane viscosityX = laneSet(0.f), viscosityY = laneSet(0.f), viscosityZ = laneSet(0.f);
+	for (; j + LANE_WIDTH <= end; j += LANE_WIDTH)
+	{
+		Lane dx = laneSub(xs, laneLoad(&spx[j]));
+		Lane dy = laneSub(ys, laneLoad(&spy[j]));
+		Lane dz = laneSub(zs, laneLoad(&spz[j]));
+		Lane r2 = laneAdd(laneAdd(laneMul(dx, dx), laneMul(dy, dy)), laneMul(dz, dz));
+		Lane inRange = laneAnd(laneNotSelf(j, s), laneLessEqual(r2, h2s));
+
+		Lane r = laneSqrt(r2);
+		Lane hr = laneSub(hs, r);
+		Lane neighborDensity = laneLoad(&sdensity[j]);
+		Lane neighborPressure = laneMul(stiffnesses, laneSub(neighborDensity, restDensities));
+
+		// (pi + pj) / rho_j * (h - r)^2 / r, masked after the division so self and far lanes add zero
+		Lane pressureScale = laneDiv(laneMul(laneAdd(pressures, neighborPressure), laneMul(hr, hr)), laneMul(neighborDensity, r));
+		pressureScale = laneAnd(inRange, pressureScale);
+		pressureX = laneAdd(pressureX, laneMul(pressureScale, dx));
+		pressureY = laneAdd(pressureY, laneMul(pressureScale, dy));
+		pressureZ = laneAdd(pressureZ, laneMul(pressureScale, dz));
+
+		// (h - r) / rho_j * (v_j - v_i)
+		Lane viscosityScale = laneAnd(inRange, laneDiv(hr, neighborDensity));
+		viscosityX = laneAdd(viscosityX, laneMul(viscosityScale, laneSub(laneLoad(&svx[j]), velXs)));
+		viscosityY = laneAdd(viscosityY, laneMul(viscosityScale, laneSub(laneLoad(&svy[j]), velYs)));
+		viscosityZ = laneAdd(viscosityZ, laneMul(viscosityScale, laneSub(laneLoad(&svz[j]), velZs)));
+	}
+	pressureSum[0] += laneSum(pressureX);
+	pressureSum[1] += laneSum(pressureY);
+	pressureSum[2] += laneSum(pressureZ);
+	viscositySum[0] += laneSum(viscosityX);
+	viscositySum[1] += laneSum(viscosityY);
+	viscositySum[2] += laneSum(viscosityZ);
+#endif
+
+	for (; j < end; ++j)
+	{
+		if (j == s) continue; // skip the current particle
+		float dx = x - spx[j], dy = y - spy[j], dz = z - spz[j];
+		float r2 = dx * dx + dy * dy + dz * dz;
+		if (r2 > h2) continue;
+
+		float r = std::sqrt(r2);
+		float hr = h - r;
+		float neighborDensity = sdensity[j];
+		float neighborPressure = params.stiffness * (neighborDensity - params.restDensity);
+
+		float pressureScale = (pressure + neighborPressure) * hr * hr / (neighborDensity * r);
+		pressureSum[0] += pressureScale * dx;
+		pressureSum[1] += pressureScale * dy;
+		pressureSum[2] += pressureScale * dz;
+
+		float viscosityScale = hr / neighborDensity;
+		viscositySum[0] += viscosityScale * (svx[j] - velX);
+		viscositySum[1] += viscosityScale * (svy[j] - velY);
+		viscositySum[2] += viscosityScale * (svz[j] - velZ);
+	}
+
+	// constant factors of accumulateForce in forceCompute.comp
+	float pressureFactor = PARTICLE_MASS * 0.5f * spikyCoefficient;
+	float viscosityFactor = params.viscosity * PARTICLE_MASS * viscosityCoefficient;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		pressureForce[axis] -= pressureFactor * pressureSum[axis];
+		viscosityForce[axis] += viscosityFactor * viscositySum[axis];
+	}
+}
+
+void CpuSolver::computeForce()
+{
+	pool.parallelFor(count, [&](size_t begin, size_t end) {
+		for (size_t s = begin; s < end; s++)
+		{
+			uint32_t slot = static_cast<uint32_t>(s);
+			float position[3] = { spx[s], spy[s], spz[s] };
+			float velocity[3] = { svx[s], svy[s], svz[s] };
+			float currentDensity = sdensity[s];
+			float currentPressure = params.stiffness * (currentDensity - params.restDensity);
+
+			float pressureForce[3] = { 0.f, 0.f, 0.f };
+			float viscosityForce[3] = { 0.f, 0.f, 0.f };
+			forEachNeighborRange(cellCoord(position[0], position[1], position[2]), [&](uint32_t cellBegin, uint32_t cellEnd) {
+				forceSum(slot, cellBegin, cellEnd, currentPressure, pressureForce, viscosityForce);
+			});
+
+			// mirror particles for each boundary, as in forceCompute.comp
+			// static boundary, rest density and no pressure, velocity reflected on the axis
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float pos = position[axis];
+				float vel = velocity[axis];
+				float distances[2] = { pos + BOX_SIZE, BOX_SIZE - pos };
+				float mirrorOffsets[2] = { 2.f * (pos + BOX_SIZE), 2.f * (pos - BOX_SIZE) }; // position minus mirror position
+				for (int side = 0; side < 2; ++side)
+				{
+					if (distances[side] >= h) continue;
+
+					float rAxis = mirrorOffsets[side];
+					float r = std::abs(rAxis);
+					if (r > 0.f && r <= h)
+					{
+						float hr = h - r;
+						float kernelGrad = spikyCoefficient * hr * hr * (rAxis / r);
+						pressureForce[axis] -= MIRROR_INFLUENCE_SCALE * PARTICLE_MASS * (currentPressure / (2.f * params.restDensity)) * kernelGrad;
+
+						float laplacian = viscosityCoefficient * hr;
+						viscosityForce[axis] += MIRROR_INFLUENCE_SCALE * params.viscosity * PARTICLE_MASS * (-2.f * vel / params.restDensity) * laplacian;
+					}
+				}
+			}
+
+			uint32_t i = sortedIndices[s];
+			fx[i] = pressureForce[0] + viscosityForce[0];
+			fy[i] = pressureForce[1] + viscosityForce[1] + currentDensity * GRAVITY;
+			fz[i] = pressureForce[2] + viscosityForce[2];
+		}
+	});
+}
+
+void CpuSolver::integrate(float dt)
+{
+	const float domainMin = -BOX_SIZE, domainMax = BOX_SIZE;
+
+	pool.parallelFor(count, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+		{
+			float position[3] = { px[i], py[i], pz[i] };
+			float velocity[3] = { vx[i], vy[i], vz[i] };
+			float force[3] = { fx[i], fy[i], fz[i] };
+
+			// Simple physics update
+			float predictedPosition[3];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				velocity[axis] += force[axis] / density[i] * dt;
+				predictedPosition[axis] = velocity[axis] * dt + position[axis];
+			}
+
+			// Handle collisions with boundaries on each axis, as in positionCompute.comp
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float pos = position[axis];
+				float vel = velocity[axis];
+				float boundary = predictedPosition[axis] < domainMin ? domainMin : domainMax;
+
+				if (predictedPosition[axis] < domainMin || predictedPosition[axis] > domainMax)
+				{
+					// Time to collision
+					float timeCollision = (boundary - pos) / vel;
+
+					if (timeCollision >= 0.f && timeCollision <= dt)
+					{
+						// move to the collision point, reflect and move for the remaining time
+						pos += vel * timeCollision;
+						vel = -vel * RESTITUTION_COEFFICIENT;
+						pos += vel * (dt - timeCollision);
+
+						// Correct for any penetration due to numerical errors
+						if (boundary == domainMin && pos < domainMin)
+							pos = domainMin + (domainMin - pos);
+						else if (boundary == domainMax && pos > domainMax)
+							pos = domainMax - (pos - domainMax);
+					}
+					else
+					{
+						// No collision within time step
+						pos = predictedPosition[axis];
+					}
+				}
+				else
+				{
+					pos = predictedPosition[axis];
+				}
+
+				position[axis] = pos;
+				velocity[axis] = vel;
+			}
+
+			px[i] = position[0];
+			py[i] = position[1];
+			pz[i] = position[2];
+			vx[i] = velocity[0];
+			vy[i] = velocity[1];
+			vz[i] = velocity[2];
+		}
+	});
+}
+
+SolverDifference compareParticles(const ParticleReadback& reference, const ParticleReadback& result)
+{
+	auto relative = [](float expected, float actual) { return std::abs(expected - actual) / std::max(std::abs(expected), 1.f); };
+
+	SolverDifference difference;
+	size_t count = std::min(reference.positions.size(), result.positions.size());
+	difference.invalid = std::max(reference.positions.size(), result.positions.size()) - count;
+	for (size_t i = 0; i < count; i++)
+	{
+		float particleDifference[3] = { 0.f, 0.f, 0.f };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			particleDifference[0] = std::max(particleDifference[0], relative(reference.positions[i][axis], result.positions[i][axis]));
+			particleDifference[1] = std::max(particleDifference[1], relative(reference.velocities[i][axis], result.velocities[i][axis]));
+		}
+		particleDifference[2] = relative(reference.densities[i], result.densities[i]);
+
+		// NaN compares false, so count it separately instead of letting it vanish in max
+		if (!std::isfinite(particleDifference[0] + particleDifference[1] + particleDifference[2]))
+		{
+			difference.invalid++;
+			continue;
+		}
+		difference.position = std::max(difference.position, particleDifference[0]);
+		difference.velocity = std::max(difference.velocity, particleDifference[1]);
+		difference.density = std::max(difference.density, particleDifference[2]);
+	}
+	return difference;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "SimulationParameters.h"
+#include "ThreadPool.h"
+
+// CPU version of densityCompute.comp, forceCompute.comp and positionCompute.comp
+// used to validate the GPU kernels and as a fallback without a capable GPU.
+// neighbors come from a cell list like the grid search, kernels run over
+// structure of arrays with AVX2 or SSE when the build enables them
+class CpuSolver
+{
+public:
+	// 0 threads uses every hardware thread
+	explicit CpuSolver(const SimulationParameters& params, unsigned threadCount = 0);
+
+	void setParticles(const std::vector<glm::vec4>& positions, const std::vector<glm::vec4>& velocities);
+	// density, force and position pass, same order as the GPU
+	void step(float dt);
+	// particles in the order they were set, densities are the ones of the last step
+	ParticleReadback readback() const;
+
+	// which kernels the build was compiled with
+	static const char* simdName();
+
+private:
+	void buildCellList();
+	void computeDensity();
+	void computeForce();
+	void integrate(float dt);
+
+	// sum over the sorted slots [begin, end) skipping self, SIMD over neighbors
+	float densitySum(float x, float y, float z, uint32_t begin, uint32_t end, uint32_t self) const;
+	void forceSum(uint32_t s, uint32_t begin, uint32_t end, float pressure, float* pressureForce, float* viscosityForce) const;
+
+	glm::ivec3 cellCoord(float x, float y, float z) const;
+	int cellIndex(const glm::ivec3& coord) const;
+	// calls function(begin, end) with the sorted slots of each cell around coord
+	template<typename Function>
+	void forEachNeighborRange(const glm::ivec3& coord, Function function) const;
+
+	SimulationParameters params;
+	ThreadPool pool;
+	uint32_t count = 0;
+	int gridDim = 0;
+
+	// kernel constants, same formulas as the shaders
+	float h = 0.f;
+	float h2 = 0.f;
+	float poly6Coefficient = 0.f;
+	float spikyCoefficient = 0.f;
+	float viscosityCoefficient = 0.f;
+
+	// particle state in the order it was set
+	std::vector<float> px, py, pz;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> fx, fy, fz;
+	std::vector<float> density;
+
+	// cell list rebuilt every step, counting sort by cell like the GPU grid
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> cellCount;
+	std::vector<uint32_t> particleCell;
+	std::vector<uint32_t> sortedIndices;
+
+	// copies in cell order so the particles of a cell are contiguous for the SIMD loops
+	std::vector<float> spx, spy, spz;
+	std::vector<float> svx, svy, svz;
+	std::vector<float> sdensity;
+};
+
+// largest difference between two particle states stored in the same order
+// each error is relative to max(|reference|, 1) so values near zero compare absolutely
+struct SolverDifference
+{
+	float position = 0.f;
+	float velocity = 0.f;
+	float density = 0.f;
+	size_t invalid = 0; // particles where either side is not finite
+};
+
+SolverDifference compareParticles(const ParticleReadback& reference, const ParticleReadback& result);
@@ -0,0 +1,73 @@
+#include "FrameConstants.h"
+#include "Defines.h"
+#include <cstring>
+#include <algorithm>
+
+void FrameConstants::init(VmaAllocator allocator, VkPhysicalDevice gpu, VkDeviceSize partitionSize, int partitionCount)
+{
+	this->allocator = allocator;
+	this->partitionCount = partitionCount;
+
+	// dynamic offsets have to be multiples of it
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpu, &properties);
+	alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 16);
+	this->partitionSize = (partitionSize + alignment - 1) / alignment * alignment;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = this->partitionSize * partitionCount;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+	// mapped once for the lifetime of the buffer, the frames only memcpy
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo allocationInfo;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &allocationInfo));
+	mapped = reinterpret_cast<char*>(allocationInfo.pMappedData);
+
+	beginFrame(0);
+}
+
+void FrameConstants::cleanUp()
+{
+	if (buffer.buffer == VK_NULL_HANDLE)
+		return;
+
+	vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+	buffer = {};
+	mapped = nullptr;
+}
+
+void FrameConstants::beginFrame(int partition)
+{
+	currentPartition = partition % partitionCount;
+	offset = 0;
+	flushedEnd = 0;
+}
+
+uint32_t FrameConstants::push(const void* data, VkDeviceSize size)
+{
+	if (size > partitionSize - offset)
+	{
+		std::cout << "FrameConstants: partition of " << partitionSize << " bytes full, " << size << " more pushed" << std::endl;
+		abort();
+	}
+
+	uint32_t pushOffset = static_cast<uint32_t>(currentPartition * partitionSize + offset);
+	memcpy(mapped + pushOffset, data, size);
+	offset = (offset + size + alignment - 1) / alignment * alignment;
+	return pushOffset;
+}
+
+void FrameConstants::flush()
+{
+	if (offset == flushedEnd)
+		return;
+
+	// memory may not be host coherent
+	VK_CHECK(vmaFlushAllocation(allocator, buffer.allocation, currentPartition * partitionSize + flushedEnd, offset - flushedEnd));
+	flushedEnd = offset;
+}
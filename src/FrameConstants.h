@@ -0,0 +1,36 @@
+#pragma once
+#include <vk_types.h>
+
+// per frame constants in one persistently mapped uniform buffer, split into a partition per frame in flight.
+// every system pushes what it needs this frame and binds it with the returned dynamic offset,
+// a partition is only written again once the ring of its frame has waited for the frame
+class FrameConstants
+{
+public:
+	void init(VmaAllocator allocator, VkPhysicalDevice gpu, VkDeviceSize partitionSize, int partitionCount);
+	void cleanUp();
+
+	// start filling the partition of a frame, the ring already waited for its last submit
+	void beginFrame(int partition);
+	// copy data into the current partition, returns the dynamic offset to bind it with.
+	// the pushes of a frame are fixed, so a full partition is a sizing error and aborts like VK_CHECK
+	uint32_t push(const void* data, VkDeviceSize size);
+	template<typename T>
+	uint32_t push(const T& value) { return push(&value, sizeof(T)); }
+	// make this frame's pushes visible to the device, before the submit reading them
+	void flush();
+
+	VkBuffer getBuffer() const { return buffer.buffer; }
+
+private:
+	VmaAllocator allocator = VK_NULL_HANDLE;
+	AllocatedBuffer buffer = {};
+	char* mapped = nullptr;
+	VkDeviceSize alignment = 256; // minUniformBufferOffsetAlignment
+	VkDeviceSize partitionSize = 0;
+	int partitionCount = 0;
+
+	int currentPartition = 0;
+	VkDeviceSize offset = 0;       // used so far in the current partition
+	VkDeviceSize flushedEnd = 0;
+};
@@ -0,0 +1,192 @@
+#include "GpuProfiler.h"
+#include "Defines.h"
+#include <algorithm>
+#include <iomanip>
+
+void GpuProfiler::PassTiming::addSample(double ms)
+{
+	if (sampleCount == SAMPLE_COUNT)
+		sum -= samples[nextSample];
+	else
+		sampleCount++;
+
+	samples[nextSample] = ms;
+	sum += ms;
+	nextSample = (nextSample + 1) % SAMPLE_COUNT;
+
+	lastMs = ms;
+	averageMs = sum / sampleCount;
+}
+
+void GpuProfiler::init(VkDevice device, VkPhysicalDevice gpu, const std::vector<uint32_t>& queueFamilies, uint32_t poolCount, uint32_t maxScopes)
+{
+	this->device = device;
+	this->maxScopes = maxScopes;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpu, &properties);
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	// every queue the passes are recorded on has to support timestamps
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(gpu, &familyCount, families.data());
+
+	uint32_t validBits = 64;
+	for (uint32_t family : queueFamilies)
+		validBits = std::min(validBits, families[family].timestampValidBits);
+
+	enabled = validBits > 0;
+	if (!enabled)
+	{
+		std::cout << "GPU profiler disabled, the queues do not support timestamps" << std::endl;
+		return;
+	}
+	timestampMask = validBits == 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = maxScopes * 2;
+
+	pools.resize(poolCount);
+	for (FramePool& framePool : pools)
+		VK_CHECK(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &framePool.queryPool));
+	currentPool = 0;
+}
+
+void GpuProfiler::cleanUp()
+{
+	for (FramePool& framePool : pools)
+		vkDestroyQueryPool(device, framePool.queryPool, nullptr);
+	pools.clear();
+	enabled = false;
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd)
+{
+	if (!enabled)
+		return;
+
+	currentPool = (currentPool + 1) % pools.size();
+	FramePool& framePool = pools[currentPool];
+
+	// the frame that used this pool is old enough to be done, if it is not its results are dropped
+	collect(framePool);
+	framePool.scopeNames.clear();
+
+	vkCmdResetQueryPool(cmd, framePool.queryPool, 0, maxScopes * 2);
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer cmd, const char* name)
+{
+	if (!enabled)
+		return UINT32_MAX;
+
+	FramePool& framePool = pools[currentPool];
+	if (framePool.scopeNames.size() == maxScopes)
+	{
+		if (!warnedFull)
+		{
+			std::cout << "GPU profiler full at " << maxScopes << " scopes per frame, later passes are not timed" << std::endl;
+			warnedFull = true;
+		}
+		return UINT32_MAX;
+	}
+
+	uint32_t scope = static_cast<uint32_t>(framePool.scopeNames.size());
+	framePool.scopeNames.push_back(name);
+	framePool.pending = true;
+
+	// bottom of pipe waits for the work before it, so a scope only measures its own passes
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, framePool.queryPool, scope * 2);
+	return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer cmd, uint32_t scope)
+{
+	if (!enabled || scope == UINT32_MAX)
+		return;
+
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pools[currentPool].queryPool, scope * 2 + 1);
+}
+
+void GpuProfiler::collectAll()
+{
+	if (!enabled)
+		return;
+
+	// oldest first so the rolling averages see the frames in order
+	for (size_t i = 1; i <= pools.size(); i++)
+		collect(pools[(currentPool + i) % pools.size()]);
+}
+
+void GpuProfiler::collect(FramePool& framePool)
+{
+	if (!framePool.pending)
+		return;
+	framePool.pending = false;
+
+	// value and availability for every query, no wait flag so this never stalls
+	uint32_t queryCount = static_cast<uint32_t>(framePool.scopeNames.size()) * 2;
+	std::vector<uint64_t> results(queryCount * 2);
+	vkGetQueryPoolResults(device, framePool.queryPool, 0, queryCount, results.size() * sizeof(uint64_t), results.data(),
+						  2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+	// scopes with the same name, e.g. one per substep, add up to one sample for the frame
+	std::vector<std::pair<std::string, double>> frameTimes;
+	for (size_t scope = 0; scope < framePool.scopeNames.size(); scope++)
+	{
+		const uint64_t* begin = &results[scope * 4];
+		const uint64_t* end = &results[scope * 4 + 2];
+		if (begin[1] == 0 || end[1] == 0)
+			continue;
+
+		uint64_t ticks = (end[0] - begin[0]) & timestampMask;
+		double ms = ticks * timestampPeriod * 1e-6;
+		const std::string& name = framePool.scopeNames[scope];
+		auto it = std::find_if(frameTimes.begin(), frameTimes.end(), [&](const std::pair<std::string, double>& time) { return time.first == name; });
+		if (it != frameTimes.end())
+			it->second += ms;
+		else
+			frameTimes.emplace_back(name, ms);
+	}
+
+	for (const std::pair<std::string, double>& time : frameTimes)
+		getTiming(time.first).addSample(time.second);
+}
+
+GpuProfiler::PassTiming& GpuProfiler::getTiming(const std::string& name)
+{
+	auto it = std::find_if(timings.begin(), timings.end(), [&](const PassTiming& timing) { return timing.name == name; });
+	if (it != timings.end())
+		return *it;
+
+	timings.emplace_back();
+	timings.back().name = name;
+	return timings.back();
+}
+
+void GpuProfiler::printSummary(std::ostream& out) const
+{
+	double total = 0.0;
+	out << "GPU ms:";
+	for (const PassTiming& timing : timings)
+	{
+		out << " " << timing.name << " " << std::fixed << std::setprecision(3) << timing.averageMs;
+		total += timing.averageMs;
+	}
+	out << " | total " << total << std::defaultfloat << std::endl;
+}
+
+void GpuProfiler::writeCsvHeader(std::ostream& out)
+{
+	out << "frame,pass,average_ms,last_ms\n";
+}
+
+void GpuProfiler::writeCsv(std::ostream& out, int frame) const
+{
+	for (const PassTiming& timing : timings)
+		out << frame << ',' << timing.name << ',' << timing.averageMs << ',' << timing.lastMs << '\n';
+}
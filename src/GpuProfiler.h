@@ -0,0 +1,76 @@
+#pragma once
+#include <vk_types.h>
+#include <vector>
+#include <string>
+#include <array>
+#include <ostream>
+
+// GPU time of each pass from timestamp queries. every frame records into the next
+// query pool of a ring, and a pool is read back when the ring comes around to it again,
+// so the results are a frame or more late but reading them never waits on the GPU
+class GpuProfiler
+{
+public:
+	static const int SAMPLE_COUNT = 64; // frames in the rolling average
+
+	struct PassTiming
+	{
+		std::string name;
+		double lastMs = 0.0;
+		double averageMs = 0.0;
+
+		void addSample(double ms);
+
+	private:
+		std::array<double, SAMPLE_COUNT> samples = {};
+		int sampleCount = 0;
+		int nextSample = 0;
+		double sum = 0.0;
+	};
+
+	// pool count has to cover the frames that can be in flight, max scopes the scopes one frame records.
+	// a pass is timed once per substep, so that grows with the steps per frame
+	void init(VkDevice device, VkPhysicalDevice gpu, const std::vector<uint32_t>& queueFamilies, uint32_t poolCount, uint32_t maxScopes);
+	void cleanUp();
+
+	// move to the next pool, read back what it recorded last time and reset it
+	void beginFrame(VkCommandBuffer cmd);
+	// returns the scope to pass to endScope, passes in other command buffers of the frame can be timed too
+	uint32_t beginScope(VkCommandBuffer cmd, const char* name);
+	void endScope(VkCommandBuffer cmd, uint32_t scope);
+	// read back every pool that is ready, for when the device is idle
+	void collectAll();
+	// forget the samples so far, e.g. after warming up
+	void resetTimings() { timings.clear(); }
+
+	bool isEnabled() const { return enabled; }
+	const std::vector<PassTiming>& getTimings() const { return timings; }
+
+	// one line with the average of every pass
+	void printSummary(std::ostream& out) const;
+	// one row per pass, frame,pass,average_ms,last_ms
+	void writeCsv(std::ostream& out, int frame) const;
+	static void writeCsvHeader(std::ostream& out);
+
+private:
+	struct FramePool
+	{
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		std::vector<std::string> scopeNames; // scope i uses queries 2i and 2i + 1
+		bool pending = false;
+	};
+
+	void collect(FramePool& framePool);
+	PassTiming& getTiming(const std::string& name);
+
+	VkDevice device = VK_NULL_HANDLE;
+	bool enabled = false;
+	double timestampPeriod = 1.0; // nanoseconds per tick
+	uint64_t timestampMask = ~0ull;
+	uint32_t maxScopes = 0;
+	bool warnedFull = false; // scopes past maxScopes are not timed, said once
+
+	std::vector<FramePool> pools;
+	uint32_t currentPool = 0;
+	std::vector<PassTiming> timings;
+};
@@ -1,5 +1,6 @@
 #include "InputManager.h"
 #include "vk_engine.h"
+#include "imgui_impl_sdl.h"
 
 
 std::map<SDL_Keycode, KeyStates> InputGlobal::keyboardStates;
@@ -17,6 +18,8 @@ void InputManager::update(float)
 	//Handle events on queue
 	while (SDL_PollEvent(&e) != 0)
 	{
+		// let the ui see the event too
+		ImGui_ImplSDL2_ProcessEvent(&e);
 		//close the window when user alt-f4s or clicks the X button			
 		if (e.type == SDL_QUIT) bQuit = true;
 		else if (e.type == SDL_KEYDOWN)
@@ -0,0 +1,99 @@
+#include "MarchingCubes.h"
+#include <array>
+#include <cstddef>
+
+// corners of the unit cube are (0,0,0) (1,0,0) (1,1,0) (0,1,0) then the same at z = 1
+static const int EDGES[12][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 }, { 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 }, { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 } };
+// corners of every face in order around it
+static const int FACES[6][4] = { { 0, 1, 2, 3 }, { 4, 5, 6, 7 }, { 0, 1, 5, 4 }, { 3, 2, 6, 7 }, { 0, 3, 7, 4 }, { 1, 2, 6, 5 } };
+
+static int edgeBetween(int a, int b)
+{
+	for (int edge = 0; edge < 12; edge++)
+	{
+		if ((EDGES[edge][0] == a && EDGES[edge][1] == b) || (EDGES[edge][0] == b && EDGES[edge][1] == a))
+			return edge;
+	}
+	return -1;
+}
+
+std::vector<int32_t> buildMarchingCubesTable()
+{
+	std::vector<int32_t> table(256 * MARCHING_CUBES_TABLE_STRIDE, -1);
+	for (int cubeIndex = 0; cubeIndex < 256; cubeIndex++)
+	{
+		// every crossed edge lies on two faces and is joined to one crossed edge on each
+		std::array<std::array<int, 2>, 12> links;
+		std::array<int, 12> linkCount = {};
+		auto link = [&](int a, int b) {
+			links[a][linkCount[a]++] = b;
+			links[b][linkCount[b]++] = a;
+		};
+
+		for (const auto& face : FACES)
+		{
+			bool inside[4];
+			int faceEdges[4];
+			int crossedCount = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				inside[i] = (cubeIndex >> face[i]) & 1;
+				faceEdges[i] = edgeBetween(face[i], face[(i + 1) % 4]);
+			}
+			for (int i = 0; i < 4; i++)
+				crossedCount += inside[i] != inside[(i + 1) % 4] ? 1 : 0;
+
+			if (crossedCount == 2)
+			{
+				int crossed[2];
+				int found = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					if (inside[i] != inside[(i + 1) % 4])
+						crossed[found++] = faceEdges[i];
+				}
+				link(crossed[0], crossed[1]);
+			}
+			// ambiguous, the two inside corners are opposite each other and each one is cut off on its own
+			else if (crossedCount == 4)
+			{
+				for (int i = 0; i < 4; i++)
+				{
+					if (inside[i])
+						link(faceEdges[(i + 3) % 4], faceEdges[i]);
+				}
+			}
+		}
+
+		// the links form closed loops around the inside corners, each loop is fanned into triangles
+		std::array<bool, 12> visited = {};
+		int written = 0;
+		for (int start = 0; start < 12; start++)
+		{
+			if (linkCount[start] == 0 || visited[start])
+				continue;
+
+			std::vector<int> loop;
+			int previous = -1;
+			int current = start;
+			while (!visited[current])
+			{
+				visited[current] = true;
+				loop.push_back(current);
+				int next = links[current][0] == previous ? links[current][1] : links[current][0];
+				previous = current;
+				current = next;
+			}
+
+			for (size_t i = 1; i + 1 < loop.size(); i++)
+			{
+				int32_t* triangle = &table[cubeIndex * MARCHING_CUBES_TABLE_STRIDE + written];
+				triangle[0] = loop[0];
+				triangle[1] = loop[i];
+				triangle[2] = loop[i + 1];
+				written += 3;
+			}
+		}
+	}
+	return table;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// entries per case of the triangle table, at most five triangles and a -1 after the last one
+const int MARCHING_CUBES_TABLE_STRIDE = 16;
+
+// triangle table of marching cubes, the edges every triangle of a case connects. a case has bit i set
+// when corner i is inside the surface. corners and edges are numbered like in surface.glsl.
+// built from the faces of the cube instead of typed in: on every face the crossed edges are joined
+// so that inside corners are cut off, which also decides the ambiguous faces the same way for both
+// cells sharing them, so the surface has no holes
+std::vector<int32_t> buildMarchingCubesTable();
@@ -1,8 +1,9 @@
 #include <tiny_obj_loader.h>
 #include <iostream>
+#include <cmath>
 #include "Mesh.h"
 const float PI = 3.1415926;
-const float R = 0.5f;
+const float R = SPHERE_RADIUS;
 VertexInputDescription Vertex::getVertexDescription()
 {
 	VertexInputDescription description;
@@ -165,4 +166,60 @@ void generateSphere(Mesh& mesh, int numDivisions)
 	}
 }
 
-AllocatedBuffer StorageBuffer::storageBuffer;
\ No newline at end of file
+void initParticles(uint32_t count, glm::vec4* positions, glm::vec4* velocities)
+{
+	float goldenRatio = (1.0f + std::sqrt(5.0f)) / 2.0f;
+
+	// same layout as the spiral emitter of initParticles.comp
+	for (size_t i = 0; i < count; i++)
+	{
+		float t = float(i) / float(count);
+		float inclination = std::acos(1.0f - 2.0f * t) * 5;
+		float turns = goldenRatio * float(i);
+		float azimuth = 2.0f * 3.14159265358979323846f * (turns - std::floor(turns));
+
+		positions[i].x = std::sin(inclination) * std::cos(azimuth);
+		positions[i].y = std::sin(inclination) * std::sin(azimuth);
+		positions[i].z = std::cos(inclination);
+		positions[i].w = 1.f;
+
+		velocities[i] = glm::vec4(0, 0, 0, 0);
+	}
+}
+
+VkDeviceSize StorageBuffer::positionSize = 0;
+VkDeviceSize StorageBuffer::velocitySize = 0;
+VkDeviceSize StorageBuffer::forceSize = 0;
+VkDeviceSize StorageBuffer::densitySize = 0;
+VkDeviceSize StorageBuffer::lambdaSize = 0;
+VkDeviceSize StorageBuffer::alphaSize = 0;
+std::array<AllocatedBuffer, 2> StorageBuffer::positionBuffers;
+std::array<AllocatedBuffer, 2> StorageBuffer::velocityBuffers;
+std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> StorageBuffer::renderPositionBuffers;
+std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> StorageBuffer::renderVelocityBuffers;
+VkDeviceSize StorageBuffer::visibleIndexSize = 0;
+std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> StorageBuffer::visibleIndexBuffers;
+std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> StorageBuffer::drawCommandBuffers;
+AllocatedBuffer StorageBuffer::forceBuffer;
+AllocatedBuffer StorageBuffer::densityBuffer;
+AllocatedBuffer StorageBuffer::lambdaBuffer;
+AllocatedBuffer StorageBuffer::alphaBuffer;
+AllocatedBuffer StorageBuffer::timeStepBuffer;
+AllocatedBuffer StorageBuffer::dfsphStateBuffer;
+VkDeviceSize GridBuffer::cellSize = 0;
+VkDeviceSize GridBuffer::particleCellSize = 0;
+VkDeviceSize GridBuffer::sortedIndexSize = 0;
+AllocatedBuffer GridBuffer::cellBuffer;
+AllocatedBuffer GridBuffer::particleCellBuffer;
+AllocatedBuffer GridBuffer::sortedIndexBuffer;
+VkDeviceSize SurfaceBuffer::fieldSize = 0;
+VkDeviceSize SurfaceBuffer::cellCountSize = 0;
+VkDeviceSize SurfaceBuffer::blockSize = 0;
+VkDeviceSize SurfaceBuffer::tableSize = 0;
+VkDeviceSize SurfaceBuffer::vertexSize = 0;
+AllocatedBuffer SurfaceBuffer::fieldBuffer;
+AllocatedBuffer SurfaceBuffer::cellCountBuffer;
+AllocatedBuffer SurfaceBuffer::blockBuffer;
+AllocatedBuffer SurfaceBuffer::tableBuffer;
+AllocatedBuffer SurfaceBuffer::vertexBuffer;
+AllocatedBuffer SurfaceBuffer::drawCommandBuffer;
\ No newline at end of file
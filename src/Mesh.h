@@ -5,16 +5,6 @@
 #include <glm/glm.hpp>
 #include "vk_types.h"
 
-const int MAX_INSTANCE = 1024*32; // max particles for now
-const int THREADS_PER_GROUP = 256;
-
-struct Particle
-{
-    glm::vec4 pos, velocity, force;
-    float density;
-    float pad[3];
-};
-
 struct VertexInputDescription
 {
     std::vector<VkVertexInputBindingDescription> bindings;
@@ -57,14 +47,174 @@ struct RenderObject
     glm::mat4 transformMatrix;
 };
 
-// for particles information
+// for particles information, stored as structure of arrays
+// one buffer per attribute so each pass only binds what it touches
+// sizes follow the particle count the engine was initialized with
 struct StorageBuffer
 {
-    std::array<Particle, MAX_INSTANCE> particles;
+    static VkDeviceSize positionSize;
+    static VkDeviceSize velocitySize;
+    static VkDeviceSize forceSize;
+    static VkDeviceSize densitySize;
+    static VkDeviceSize lambdaSize;
+    static VkDeviceSize alphaSize;
+
+    // ping-pong pairs, particles are reordered by cell from the current one into the other
+    static std::array<AllocatedBuffer, 2> positionBuffers;
+    static std::array<AllocatedBuffer, 2> velocityBuffers;
+    // what the renderer reads, written by the last pass of a step. one pair per frame in flight
+    // so the next step can run while the previous frame is still being drawn
+    static std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> renderPositionBuffers;
+    static std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> renderVelocityBuffers;
+    // graphics only, one per render copy. indices of the particles that passed the frustum culling
+    // and the indirect draw commands counting them, a ParticleDrawCommands. the indices have a
+    // particle count sized range per sphere level of detail
+    static VkDeviceSize visibleIndexSize;
+    static std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> visibleIndexBuffers;
+    static std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> drawCommandBuffers;
+    // recomputed every step, no need to reorder
+    static AllocatedBuffer forceBuffer;
+    static AllocatedBuffer densityBuffer;
+    // PBF lambdas or DFSPH stiffness, one float per particle
+    static AllocatedBuffer lambdaBuffer;
+    // DFSPH only, one float per particle
+    static AllocatedBuffer alphaBuffer;
+    // a single TimeStepState
+    static AllocatedBuffer timeStepBuffer;
+    // a single DfsphState
+    static AllocatedBuffer dfsphStateBuffer;
+};
+
+// uniform grid rebuilt every frame, layouts match grid.glsl
+struct GridCell
+{
+    uint32_t count;
+    uint32_t start;
+};
+
+struct ParticleCell
+{
+    uint32_t cell;
+    uint32_t offset;
+};
+
+// adaptive time step, layout matches timeStep.glsl
+struct TimeStepState
+{
+    uint32_t maxSpeed;        // float bits
+    uint32_t maxAcceleration; // float bits
+    float dt;
+    float time;
+};
+
+// fixed point scale of the DFSPH error sums, matches ERROR_SCALE in dfsph.glsl
+const float DFSPH_ERROR_SCALE = 4096.f;
 
-    // store the info need to allocate buffer for this struct
-    // also not contribute to the class size
-    static AllocatedBuffer storageBuffer;
+// DFSPH solver state, layout matches dfsph.glsl. the first six are cleared every step,
+// the counters every submit
+struct DfsphState
+{
+    uint32_t divergenceError[2];
+    uint32_t densityError[2];
+    uint32_t divergenceDone;
+    uint32_t densityDone;
+    uint32_t steps;
+    uint32_t divergenceIterations;
+    uint32_t densityIterations;
+    uint32_t lastDensityError;
+
+    // averages over the counted steps, zero when no DFSPH step ran
+    float averageDivergenceIterations() const { return steps > 0 ? float(divergenceIterations) / steps : 0.f; }
+    float averageDensityIterations() const { return steps > 0 ? float(densityIterations) / steps : 0.f; }
+    // the error is summed over all particles
+    float densityErrorRatio(uint32_t particleCount) const { return steps > 0 ? lastDensityError / (DFSPH_ERROR_SCALE * particleCount) : 0.f; }
+};
+
+// radius of the particle sphere, the impostor renderer traces spheres of the same size
+const float SPHERE_RADIUS = 0.5f;
+// levels of detail of the particle sphere, finest first. the culling pass puts every visible particle
+// into the finest level whose smallest projected radius in pixels it still reaches
+const int SPHERE_LOD_COUNT = 4;
+const int SPHERE_LOD_DIVISIONS[SPHERE_LOD_COUNT] = { 20, 12, 8, 5 };
+const float SPHERE_LOD_MIN_PIXELS[SPHERE_LOD_COUNT] = { 24.f, 10.f, 4.f, 0.f };
+
+// indirect draws of the visible particles, layout matches cullParticles.comp
+struct ParticleDrawCommands
+{
+    // an instance of the sphere per particle, one draw per level of detail.
+    // firstInstance is the start of the level's range in the visible indices
+    VkDrawIndexedIndirectCommand mesh[SPHERE_LOD_COUNT];
+    VkDrawIndirectCommand impostor;    // six vertices per particle
 };
 
-void generateSphere(Mesh& mesh, int numDivisions);
\ No newline at end of file
+// push constants of cullParticles.comp
+struct CullPushConstants
+{
+    float radius;
+    uint32_t particleCount;
+    uint32_t lodCount;         // 1 puts every particle in the first range, the impostors have no levels
+    float pixelScale;          // projected radius in pixels times the view depth
+    float lodMinPixels[SPHERE_LOD_COUNT];
+};
+
+// push constants of fluidSmooth.comp
+struct FluidSmoothPushConstants
+{
+    glm::ivec2 direction;  // (1, 0) or (0, 1)
+    int32_t maxRadius;     // in pixels
+    float worldRadius;     // of the filter at the fluid
+    float pixelScale;      // pixels per unit at view depth 1
+    float depthFalloff;
+};
+
+struct GridBuffer
+{
+    static VkDeviceSize cellSize;
+    static VkDeviceSize particleCellSize;
+    static VkDeviceSize sortedIndexSize;
+
+    static AllocatedBuffer cellBuffer;
+    static AllocatedBuffer particleCellBuffer;
+    static AllocatedBuffer sortedIndexBuffer;
+};
+
+// water surface reconstruction, sized for GraphicsGlobal::SURFACE_RESOLUTION nodes per axis
+struct SurfaceBuffer
+{
+    static VkDeviceSize fieldSize;
+    static VkDeviceSize cellCountSize;
+    static VkDeviceSize blockSize;
+    static VkDeviceSize tableSize;
+    static VkDeviceSize vertexSize;
+
+    static AllocatedBuffer fieldBuffer;      // density splatted on the nodes, fixed point
+    static AllocatedBuffer cellCountBuffer;  // vertices of every cell, then their offsets
+    static AllocatedBuffer blockBuffer;      // vertices of every workgroup of cells, then their offsets
+    static AllocatedBuffer tableBuffer;      // buildMarchingCubesTable
+    static AllocatedBuffer vertexBuffer;
+    static AllocatedBuffer drawCommandBuffer; // a VkDrawIndirectCommand
+};
+
+// vertex the surface passes write, matches surface.glsl
+struct SurfaceVertex
+{
+    glm::vec4 position;
+    glm::vec4 normal;
+};
+
+// push constants of the surface passes, matches surface.glsl
+struct SurfacePushConstants
+{
+    uint32_t resolution;    // nodes per axis
+    uint32_t particleCount;
+    uint32_t maxVertices;
+    float nodeSpacing;
+    float radius;           // of the splat kernel
+    float isoLevel;
+};
+
+void generateSphere(Mesh& mesh, int numDivisions);
+
+// the spiral emitter of initParticles.comp on the CPU, a golden spiral at rest.
+// the GPU emits its particles itself, this is the starting state of the CPU reference solver
+void initParticles(uint32_t count, glm::vec4* positions, glm::vec4* velocities);
\ No newline at end of file
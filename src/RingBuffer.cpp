@@ -6,20 +6,29 @@ RingBuffer::RingBuffer()
 {
 }
 
-void RingBuffer::initSyncObjects(int max, VkDevice device, uint32_t graphicsQueueFamily)
+void RingBuffer::initSyncObjects(int max, VkDevice device, uint32_t queueFamily)
 {
 	this->device = device;
 	syncObjects.resize(max);
-	currentIndex = 0;
+	// so the first getNextObject returns slot 0
+	currentIndex = max - 1;
 	maxObjectNum = max;
+	lastSignalValue = 0;
 	//create synchronization structures
 
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.pNext = nullptr;
+	// one timeline for the whole ring, starts at 0 so nothing waits for the first round
+	VkSemaphoreTypeCreateInfo timelineCreateInfo = {};
+	timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineCreateInfo.pNext = nullptr;
+	timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineCreateInfo.initialValue = 0;
 
-	//we want to create the fence with the Create Signaled flag, so we can wait on it before using it on a GPU command (for the first frame)
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	VkSemaphoreCreateInfo timelineSemaphoreInfo = {};
+	timelineSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	timelineSemaphoreInfo.pNext = &timelineCreateInfo;
+	timelineSemaphoreInfo.flags = 0;
+
+	VK_CHECK(vkCreateSemaphore(device, &timelineSemaphoreInfo, nullptr, &timeline));
 
 	//for the semaphores we don't need any flags
 	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
@@ -27,18 +36,18 @@ void RingBuffer::initSyncObjects(int max, VkDevice device, uint32_t graphicsQueu
 	semaphoreCreateInfo.pNext = nullptr;
 	semaphoreCreateInfo.flags = 0;
 
-	//create a command pool for commands submitted to the graphics queue.
+	//create a command pool for commands submitted to the queue.
 	//we also want the pool to allow for resetting of individual command buffers
-	VkCommandPoolCreateInfo commandPoolInfo = vkinit::commandPoolCreateInfo(graphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+	VkCommandPoolCreateInfo commandPoolInfo = vkinit::commandPoolCreateInfo(queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 
 
 
 	
 	for (size_t i = 0; i < maxObjectNum; i++)
 	{
-		VK_CHECK(vkCreateFence(device, &fenceCreateInfo, nullptr, &syncObjects[i].renderFence));
 		VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &syncObjects[i].presentSemaphore));
 		VK_CHECK(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &syncObjects[i].renderSemaphore));
+		syncObjects[i].timelineValue = 0;
 
 		VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &syncObjects[i].commandPool));
 		//allocate the default command buffer that we will use for rendering
@@ -55,11 +64,11 @@ void RingBuffer::cleanUpSyncObjects()
 {
 	for (int i = 0; i < maxObjectNum; i++)
 	{
-		vkDestroyFence(device, syncObjects[i].renderFence, nullptr);
 		vkDestroySemaphore(device, syncObjects[i].renderSemaphore, nullptr);
 		vkDestroySemaphore(device, syncObjects[i].presentSemaphore, nullptr);
 		vkDestroyCommandPool(device, syncObjects[i].commandPool, nullptr);
 	}
+	vkDestroySemaphore(device, timeline, nullptr);
 }
 
 
@@ -68,10 +77,36 @@ RingBuffer::~RingBuffer()
 }
 
 
-SyncObject* RingBuffer::getNextObject()
+SyncObject* RingBuffer::getNextObject(uint64_t timeout)
 {
-	int index = currentIndex;
-	currentIndex = currentIndex++ % maxObjectNum;
-	return &syncObjects[index];
+	currentIndex = (currentIndex + 1) % maxObjectNum;
+	SyncObject* object = &syncObjects[currentIndex];
+	// the command buffer can only be reset once the GPU is done with it
+	wait(object->timelineValue, timeout);
+	return object;
 }
 
+SyncObject* RingBuffer::getCurrentObject()
+{
+	return &syncObjects[currentIndex];
+}
+
+uint64_t RingBuffer::signalValue(SyncObject* object)
+{
+	object->timelineValue = ++lastSignalValue;
+	return object->timelineValue;
+}
+
+void RingBuffer::wait(uint64_t value, uint64_t timeout)
+{
+	if (value == 0)
+		return;
+
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.pNext = nullptr;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &timeline;
+	waitInfo.pValues = &value;
+	VK_CHECK(vkWaitSemaphores(device, &waitInfo, timeout));
+}
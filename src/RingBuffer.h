@@ -4,25 +4,43 @@
 #include <vk_types.h>
 struct SyncObject
 {
+	// binary, swapchain acquire and present can not use timeline semaphores
 	VkSemaphore presentSemaphore, renderSemaphore;
-	VkFence renderFence;
+	// the ring timeline reaches this value once the last work submitted from this slot is done
+	uint64_t timelineValue = 0;
 
 	VkCommandPool commandPool;
 	VkCommandBuffer mainCommandBuffer;
 };
 
+// command buffers of one queue paced by a timeline semaphore, every submit signals the next value
+// so the host only has to wait when it comes around to a slot the GPU is still working on
 class RingBuffer
 {
 public:
 	RingBuffer();
-	void initSyncObjects(int max, VkDevice device, uint32_t graphicsQueueFamily);
+	void initSyncObjects(int max, VkDevice device, uint32_t queueFamily);
 	void cleanUpSyncObjects();
 	~RingBuffer();
-	SyncObject * getNextObject();
+	// move to the next slot, waits until the work last submitted from it is done
+	SyncObject * getNextObject(uint64_t timeout = UINT64_MAX);
+	// the slot getNextObject returned last, for one time commands
+	SyncObject * getCurrentObject();
+	int getCurrentIndex() const { return currentIndex; }
+
+	// value to signal the timeline with when submitting the work recorded in object
+	uint64_t signalValue(SyncObject * object);
+	// block until the timeline reaches value
+	void wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+	VkSemaphore getTimeline() const { return timeline; }
+	// value of the last submit, the other queue waits on it on the GPU
+	uint64_t getLastSignalValue() const { return lastSignalValue; }
 private:
 	int currentIndex;
 	int maxObjectNum;
 	VkDevice device;
+	VkSemaphore timeline;
+	uint64_t lastSignalValue;
 	std::vector<SyncObject> syncObjects;
 
 };
@@ -0,0 +1,189 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <glm/glm.hpp>
+
+// keep these in sync with header.glsl
+const float BOX_SIZE = 6.f; // half size of the bounding box
+const float PARTICLE_MASS = 1.2f;
+const float GRAVITY = -9.81f;
+const float KERNEL_PI = 3.14159265359f; // normalization of the SPH kernels
+
+// how density and force pass find neighbors, matches the constants in header.glsl
+enum class NeighborSearch : int
+{
+	ALL_PAIRS = 0, // exact brute force reference
+	TILED,         // brute force staged through shared memory
+	GRID
+};
+
+// what advances the particles, read every step so it can change while running
+enum class Solver : int
+{
+	SPH = 0, // weakly compressible, density, force and position pass
+	PBF,     // position based fluids, density constraint projected on predicted positions
+	DFSPH    // divergence free SPH, pressure solved for until the density error is small
+};
+
+// command line names of the solvers, anything unknown is SPH
+inline Solver solverFromName(const char* name)
+{
+	if (std::strcmp(name, "pbf") == 0)
+		return Solver::PBF;
+	if (std::strcmp(name, "dfsph") == 0)
+		return Solver::DFSPH;
+	return Solver::SPH;
+}
+
+// shape the particles start in, written on the GPU by initParticles.comp on every reset
+enum class Emitter : int
+{
+	SPIRAL = 0, // golden spiral around the center, what the CPU reference solver starts from
+	BLOCK,      // cube around the center
+	DAM_BREAK,  // column against one wall
+	JITTER      // the cube with random offsets, new ones every reset
+};
+
+inline Emitter emitterFromName(const char* name)
+{
+	if (std::strcmp(name, "block") == 0)
+		return Emitter::BLOCK;
+	if (std::strcmp(name, "dam") == 0)
+		return Emitter::DAM_BREAK;
+	if (std::strcmp(name, "jitter") == 0)
+		return Emitter::JITTER;
+	return Emitter::SPIRAL;
+}
+
+inline const char* solverName(Solver solver)
+{
+	switch (solver)
+	{
+	case Solver::SPH: return "sph";
+	case Solver::PBF: return "pbf";
+	case Solver::DFSPH: return "dfsph";
+	}
+	return "unknown";
+}
+
+// scene size and SPH constants, handed to the compute shaders as specialization constants
+// when the pipelines are created, so changing them does not need the shaders recompiled
+struct SimulationParameters
+{
+	NeighborSearch neighborSearch = NeighborSearch::GRID;
+	uint32_t particleCount = 1024 * 32;
+	uint32_t threadsPerGroup = 256;
+
+	float smoothingLength = 0.98f; // Smoothing length (h)
+	float stiffness = 120.f;       // Gas stiffness constant (k)
+	float restDensity = 980.f;     // Rest density of the fluid
+	float viscosity = 0.7f;        // Viscosity coefficient
+
+	// fixed step the simulation always advances by, independent of the frame rate
+	float timeStep = 1.f / 240.f;
+	// steps recorded into the compute command buffer of one frame. 0 follows the frame time
+	// with an accumulator, anything else runs that many steps every frame
+	uint32_t substeps = 0;
+	// most steps the accumulator records in one frame, time beyond that is dropped
+	// so a slow frame can not make the next one slower
+	uint32_t maxSubsteps = 8;
+
+	// let the GPU pick each step from the fastest and the most accelerated particle (CFL condition)
+	// instead of always taking timeStep. the step is then at most maxTimeStep, so simulated time
+	// runs ahead of the frame time in calm scenes and behind it in violent ones
+	bool adaptiveTimeStep = false;
+	float cflFactor = 0.4f;            // share of the smoothing length a particle may travel per step
+	float maxTimeStep = 1.f / 60.f;
+
+	// force and position pass as one dispatch writing the other ping-pong buffers,
+	// one barrier and one pass over the particles less per step. the adaptive time step
+	// needs every force before it can integrate, so it always keeps the separate passes
+	bool fusedIntegration = false;
+	bool useFusedIntegration() const { return fusedIntegration && !adaptiveTimeStep; }
+
+	// the incompressible solvers (PBF and DFSPH) need a rest density the particles can actually reach,
+	// it follows from the particles filling fillFraction of the box so it fits any particle count
+	float fillFraction = 0.35f;
+	float incompressibleRestDensity() const { return PARTICLE_MASS * particleCount / (fillFraction * 8.f * BOX_SIZE * BOX_SIZE * BOX_SIZE); }
+	float xsphViscosity = 0.01f;  // both smooth their velocities with XSPH instead of a viscosity force
+
+	// position based fluids
+	uint32_t pbfIterations = 4;  // constraint projections per step
+	float pbfRelaxation = 0.1f;   // added to the constraint gradients, softens particles with few neighbors
+	float tensileCorrection = 0.1f; // artificial pressure against clumping
+
+	// divergence free SPH, the Jacobi solves stop at the tolerance or after the most iterations.
+	// the host records every iteration, the ones after convergence return right away on the GPU
+	uint32_t dfsphMaxDivergenceIterations = 8;
+	uint32_t dfsphMaxDensityIterations = 16;
+	float densityTolerance = 0.001f;    // average relative density error
+	float divergenceTolerance = 0.01f;  // average relative density change over one step
+
+	// what the compute passes are pushed as dt
+	float stepTimeBound() const { return adaptiveTimeStep ? maxTimeStep : timeStep; }
+
+	// normalization constants of the SPH kernels, computed once here so the neighbor loops
+	// of the shaders and the CPU solver only multiply
+	float poly6Coefficient() const { return 315.f / (64.f * KERNEL_PI * std::pow(smoothingLength, 9.f)); }
+	float spikyCoefficient() const { return -45.f / (KERNEL_PI * std::pow(smoothingLength, 6.f)); }
+	float viscosityCoefficient() const { return 45.f / (KERNEL_PI * std::pow(smoothingLength, 6.f)); }
+
+	// workgroups needed to cover every particle
+	uint32_t groupCount() const { return (particleCount + threadsPerGroup - 1) / threadsPerGroup; }
+
+	// uniform grid for neighbor search, cell size equals the smoothing length
+	int gridDim() const { return static_cast<int>(2.f * BOX_SIZE / smoothingLength) + 1; }
+	int gridCellCount() const { return gridDim() * gridDim() * gridDim(); }
+};
+
+// what the pipelines are specialized with, constant ids follow the member order
+// and must match the constant_id layouts in header.glsl
+struct SpecializationData
+{
+	int neighborSearch;       // 0
+	uint32_t particleCount;   // 1
+	uint32_t threadsPerGroup; // 2, used as local_size_x_id
+	float smoothingLength;    // 3
+	float stiffness;          // 4
+	float restDensity;        // 5
+	float viscosity;          // 6
+	int gridDim;              // 7
+	uint32_t adaptiveTimeStep; // 8, a VkBool32
+	float cflFactor;          // 9
+	float smoothingLengthSquared; // 10, the rest are the kernel coefficients
+	float poly6Coefficient;   // 11
+	float spikyCoefficient;   // 12
+	float viscosityCoefficient; // 13
+	float incompressibleRestDensity; // 14
+	float pbfRelaxation;      // 15
+	float xsphViscosity;      // 16
+	float tensileCorrection;  // 17
+	float densityTolerance;   // 18
+	float divergenceTolerance; // 19
+};
+
+// push constants of the compute passes, matches the PushConstants blocks in the shaders
+struct ComputePushConstants
+{
+	float dt;
+	uint32_t writeRenderCopy; // position pass only, set on the last step of a frame
+	uint32_t iteration;       // DFSPH solves only, pushed again for every iteration
+	uint32_t emitter;         // init pass only, an Emitter
+	uint32_t seed;            // init pass only, differs every reset
+};
+
+// particles copied back to the host, in the order they are currently stored
+struct ParticleReadback
+{
+	std::vector<glm::vec4> positions;
+	std::vector<glm::vec4> velocities;
+	std::vector<float> densities;
+	float timeStep = 0.f;      // step the last position pass took
+	float simulatedTime = 0.f; // since the last reset
+	// DFSPH only, averages over the steps of the last submit
+	float divergenceIterations = 0.f;
+	float densityIterations = 0.f;
+	float densityError = 0.f;  // average relative density error the last density solve ended with
+};
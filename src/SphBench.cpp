@@ -0,0 +1,195 @@
+// headless benchmark of the compute pipeline, sweeps particle counts for every neighbor search
+// and writes the results as json so runs of different builds can be compared
+#include "vk_engine.h"
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+struct BenchResult
+{
+	NeighborSearch neighborSearch;
+	uint32_t particleCount;
+	int steps;
+	double seconds;
+	std::vector<GpuProfiler::PassTiming> gpuTimings;
+};
+
+const char* neighborSearchName(NeighborSearch neighborSearch)
+{
+	switch (neighborSearch)
+	{
+	case NeighborSearch::ALL_PAIRS: return "all_pairs";
+	case NeighborSearch::TILED: return "tiled";
+	case NeighborSearch::GRID: return "grid";
+	}
+	return "unknown";
+}
+
+std::string jsonString(const std::string& text)
+{
+	std::string out = "\"";
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+	return out + "\"";
+}
+
+// one engine per configuration, the buffers and pipelines are sized for the particle count
+BenchResult runBenchmark(NeighborSearch neighborSearch, uint32_t particleCount, int warmup, int steps, std::string& deviceName)
+{
+	GraphicsGlobal::SIMULATION_PARAMETERS.neighborSearch = neighborSearch;
+	GraphicsGlobal::SIMULATION_PARAMETERS.particleCount = particleCount;
+	GraphicsGlobal::RESET_PARTICLE = true;
+
+	VulkanEngine engine;
+	engine.init();
+	deviceName = engine.getDeviceName();
+
+	// the first steps upload the particles and get the pipelines warm
+	float timeStep = GraphicsGlobal::SIMULATION_PARAMETERS.stepTimeBound();
+	engine.runHeadless(warmup, timeStep);
+	engine.getProfiler().resetTimings();
+
+	auto begin = std::chrono::steady_clock::now();
+	engine.runHeadless(steps, timeStep);
+	auto end = std::chrono::steady_clock::now();
+
+	BenchResult result;
+	result.neighborSearch = neighborSearch;
+	result.particleCount = particleCount;
+	result.steps = steps;
+	result.seconds = std::chrono::duration<double>(end - begin).count();
+	result.gpuTimings = engine.getProfiler().getTimings();
+
+	engine.shutdown();
+	return result;
+}
+
+void writeJson(std::ostream& out, const std::string& deviceName, int warmup, int steps, const std::vector<BenchResult>& results)
+{
+	const SimulationParameters& params = GraphicsGlobal::SIMULATION_PARAMETERS;
+	out << "{\n";
+	out << "  \"device\": " << jsonString(deviceName) << ",\n";
+	out << "  \"warmup_steps\": " << warmup << ",\n";
+	out << "  \"steps\": " << steps << ",\n";
+	out << "  \"time_step\": " << params.timeStep << ",\n";
+	// steps recorded into one command buffer
+	int stepsPerSubmit = static_cast<int>(params.substeps > 0 ? params.substeps : params.maxSubsteps);
+	out << "  \"steps_per_submit\": " << stepsPerSubmit << ",\n";
+	out << "  \"fluid_solver\": " << jsonString(solverName(GraphicsGlobal::SOLVER)) << ",\n";
+	out << "  \"fused_integration\": " << (params.useFusedIntegration() ? "true" : "false") << ",\n";
+	out << "  \"results\": [";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& result = results[i];
+		double stepsPerSecond = result.steps / result.seconds;
+		double nsPerParticleStep = result.seconds * 1e9 / (double(result.steps) * result.particleCount);
+		// the profiler averages over the last submits, the last one can have fewer steps
+		int submits = (result.steps + stepsPerSubmit - 1) / stepsPerSubmit;
+		int averagedSubmits = std::min(submits, GpuProfiler::SAMPLE_COUNT);
+		int averagedSteps = result.steps - (submits - averagedSubmits) * stepsPerSubmit;
+		double submitsPerStep = double(averagedSubmits) / averagedSteps;
+
+		out << (i == 0 ? "\n" : ",\n");
+		out << "    {\n";
+		out << "      \"neighbor_search\": " << jsonString(neighborSearchName(result.neighborSearch)) << ",\n";
+		out << "      \"particles\": " << result.particleCount << ",\n";
+		out << "      \"seconds\": " << result.seconds << ",\n";
+		out << "      \"steps_per_second\": " << stepsPerSecond << ",\n";
+		out << "      \"ns_per_particle_step\": " << nsPerParticleStep << ",\n";
+		// per step like the rates above, empty when the device has no timestamps
+		out << "      \"gpu_ms\": {";
+		double total = 0.0;
+		for (size_t pass = 0; pass < result.gpuTimings.size(); pass++)
+		{
+			double ms = result.gpuTimings[pass].averageMs * submitsPerStep;
+			out << (pass == 0 ? " " : ", ") << jsonString(result.gpuTimings[pass].name) << ": " << ms;
+			total += ms;
+		}
+		out << " },\n";
+		out << "      \"gpu_total_ms\": " << total << "\n";
+		out << "    }";
+	}
+	out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t minParticles = 4 * 1024;
+	uint32_t maxParticles = 1024 * 1024;
+	// the brute force searches are quadratic, past this they take minutes per configuration
+	uint32_t maxBruteForce = 64 * 1024;
+	int warmup = 10;
+	int steps = 100;
+	const char* outputPath = "sph_bench.json";
+	std::vector<NeighborSearch> searches = { NeighborSearch::ALL_PAIRS, NeighborSearch::TILED, NeighborSearch::GRID };
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--min") == 0 && i + 1 < argc)
+			minParticles = std::max(1u, static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10)));
+		else if (std::strcmp(argv[i], "--max") == 0 && i + 1 < argc)
+			maxParticles = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--max-brute-force") == 0 && i + 1 < argc)
+			maxBruteForce = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+		else if (std::strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+			warmup = std::max(1, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+			steps = std::max(1, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			outputPath = argv[++i];
+		else if (std::strcmp(argv[i], "--substeps") == 0 && i + 1 < argc)
+			GraphicsGlobal::SIMULATION_PARAMETERS.substeps = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		else if (std::strcmp(argv[i], "--fused") == 0)
+			GraphicsGlobal::SIMULATION_PARAMETERS.fusedIntegration = true;
+		else if (std::strcmp(argv[i], "--solver") == 0 && i + 1 < argc)
+			GraphicsGlobal::SOLVER = solverFromName(argv[++i]);
+		// only the grid search, the brute force ones are references
+		else if (std::strcmp(argv[i], "--grid-only") == 0)
+			searches = { NeighborSearch::GRID };
+		else
+		{
+			std::cout << "usage: sph_bench [--min N] [--max N] [--max-brute-force N] [--warmup N] [--steps N] [--substeps N] [--fused] [--solver sph|pbf|dfsph] [--output file.json] [--grid-only]" << std::endl;
+			return 1;
+		}
+	}
+
+	// compute only, this also lets it run on lavapipe
+	GraphicsGlobal::HEADLESS = true;
+
+	std::string deviceName;
+	std::vector<BenchResult> results;
+	for (NeighborSearch search : searches)
+	{
+		// particle counts go up by four each time
+		for (uint64_t count = minParticles; count <= maxParticles; count *= 4)
+		{
+			if (search != NeighborSearch::GRID && count > maxBruteForce)
+			{
+				std::cout << neighborSearchName(search) << " " << count << ": skipped, above --max-brute-force" << std::endl;
+				continue;
+			}
+
+			BenchResult result = runBenchmark(search, static_cast<uint32_t>(count), warmup, steps, deviceName);
+			std::cout << neighborSearchName(search) << " " << count << ": " << result.steps / result.seconds << " steps/s, "
+					  << result.seconds * 1e9 / (double(result.steps) * count) << " ns/particle/step" << std::endl;
+			results.push_back(result);
+		}
+	}
+
+	std::ofstream file(outputPath);
+	if (!file.is_open())
+	{
+		std::cout << "Error when opening " << outputPath << std::endl;
+		return 1;
+	}
+	writeJson(file, deviceName, warmup, steps, results);
+	std::cout << "results written to " << outputPath << std::endl;
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "StagingRing.h"
+#include "Defines.h"
+#include <cstring>
+
+void StagingRing::init(VmaAllocator allocator, VkDeviceSize partitionSize, int partitionCount)
+{
+	this->allocator = allocator;
+	this->partitionSize = (partitionSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	this->partitionCount = partitionCount;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = this->partitionSize * partitionCount;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	// mapped once for the lifetime of the ring
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	VmaAllocationInfo allocationInfo;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &allocationInfo));
+	mapped = reinterpret_cast<char*>(allocationInfo.pMappedData);
+
+	currentPartition = 0;
+	offset = 0;
+}
+
+void StagingRing::cleanUp()
+{
+	if (buffer.buffer == VK_NULL_HANDLE)
+		return;
+
+	vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+	buffer = {};
+	mapped = nullptr;
+	pending.clear();
+}
+
+void StagingRing::upload(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset)
+{
+	if (size == 0)
+		return;
+	if (size > partitionSize - offset)
+	{
+		std::cout << "StagingRing: partition of " << partitionSize << " bytes full, " << size << " more uploaded" << std::endl;
+		abort();
+	}
+
+	VkDeviceSize srcOffset = currentPartition * partitionSize + offset;
+	memcpy(mapped + srcOffset, data, size);
+
+	// copies into the same buffer back to back become one region
+	if (!pending.empty())
+	{
+		PendingCopy& last = pending.back();
+		if (last.dst == dst && last.region.srcOffset + last.region.size == srcOffset && last.region.dstOffset + last.region.size == dstOffset)
+		{
+			last.region.size += size;
+			offset = (offset + size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+			return;
+		}
+	}
+
+	pending.push_back({ dst, { srcOffset, dstOffset, size } });
+	offset = (offset + size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+void StagingRing::record(VkCommandBuffer cmd)
+{
+	if (pending.empty())
+		return;
+
+	// memory may not be host coherent
+	VK_CHECK(vmaFlushAllocation(allocator, buffer.allocation, currentPartition * partitionSize, offset));
+
+	// queued in order, so copies into the same buffer stay in order
+	for (const PendingCopy& copy : pending)
+		vkCmdCopyBuffer(cmd, buffer.buffer, copy.dst, 1, &copy.region);
+	pending.clear();
+
+	// the destinations can be anything, vertices, indices or storage buffers
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	currentPartition = (currentPartition + 1) % partitionCount;
+	offset = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <vk_types.h>
+#include <vector>
+
+// persistently mapped upload buffer split into partitions, one more than the frames in flight.
+// uploads are copied into the current partition right away and the copies into their destination
+// buffers are recorded with the next frame's command buffer, which moves on to the next partition.
+// that one was last read by the frame before the last, which the ring of the frame already waited for,
+// so an upload never waits on the GPU
+class StagingRing
+{
+public:
+	void init(VmaAllocator allocator, VkDeviceSize partitionSize, int partitionCount);
+	void cleanUp();
+
+	// copy data into the current partition and queue the copy into dst. the uploads between
+	// two frames are fixed in size, so a full partition is a sizing error and aborts like VK_CHECK
+	void upload(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+	// record the queued copies, make them visible to every later command and move on to the next partition
+	void record(VkCommandBuffer cmd);
+	bool hasPending() const { return !pending.empty(); }
+
+private:
+	// copy offsets stay aligned for any data type
+	static const VkDeviceSize ALIGNMENT = 16;
+
+	struct PendingCopy
+	{
+		VkBuffer dst;
+		VkBufferCopy region;
+	};
+
+	VmaAllocator allocator = VK_NULL_HANDLE;
+	AllocatedBuffer buffer = {};
+	char* mapped = nullptr;
+	VkDeviceSize partitionSize = 0;
+	int partitionCount = 0;
+
+	int currentPartition = 0;
+	VkDeviceSize offset = 0;      // used so far in the current partition
+	std::vector<PendingCopy> pending;
+};
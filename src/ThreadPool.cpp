@@ -0,0 +1,82 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// the calling thread does its share, so one less worker
+	for (unsigned i = 1; i < threadCount; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t, size_t)>& job)
+{
+	if (count == 0)
+		return;
+
+	// a few chunks per thread so uneven chunks even out
+	size_t chunks = threadCount() * 4;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		task = &job;
+		taskCount = count;
+		chunkSize = std::max<size_t>(1, (count + chunks - 1) / chunks);
+		nextChunk = 0;
+		busyWorkers = workers.size();
+		generation++;
+	}
+	wakeCondition.notify_all();
+
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this]() { return busyWorkers == 0; });
+	task = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+	uint64_t seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+			if (stopping)
+				return;
+			seenGeneration = generation;
+		}
+
+		runChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			busyWorkers--;
+		}
+		doneCondition.notify_one();
+	}
+}
+
+void ThreadPool::runChunks()
+{
+	while (true)
+	{
+		size_t begin = nextChunk.fetch_add(chunkSize);
+		if (begin >= taskCount)
+			return;
+		(*task)(begin, std::min(begin + chunkSize, taskCount));
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// fixed set of worker threads for splitting a loop across cores
+class ThreadPool
+{
+public:
+	// 0 uses every hardware thread
+	explicit ThreadPool(unsigned threadCount = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// run task(begin, end) over chunks of [0, count), the calling thread helps and returns when all chunks are done
+	void parallelFor(size_t count, const std::function<void(size_t, size_t)>& task);
+
+	// workers plus the calling thread
+	size_t threadCount() const { return workers.size() + 1; }
+
+private:
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+
+	// current job, only changed while no worker is running it
+	const std::function<void(size_t, size_t)>* task = nullptr;
+	size_t taskCount = 0;
+	size_t chunkSize = 1;
+	std::atomic<size_t> nextChunk{ 0 };
+
+	uint64_t generation = 0; // bumped for every job so workers know there is new work
+	size_t busyWorkers = 0;
+	bool stopping = false;
+};
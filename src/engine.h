@@ -32,7 +32,8 @@ private:
 #pragma region FrameRate
 	std::chrono::high_resolution_clock::time_point frameBegin;
 	std::chrono::high_resolution_clock::time_point frameEnd;
-	const float FrameCap = 1.0f / 240.f;
+	// longest frame time handed to the systems, the simulation catches up in fixed steps
+	const float FrameCap = 0.1f;
 
 	void getDT(float& dt);
 #pragma endregion FrameRate
@@ -1,7 +1,260 @@
 #include "engine.h"
+#include "vk_engine.h"
+#include "CpuSolver.h"
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// print a short summary of the particle state, and dump every particle if a path is given
+void reportHeadless(const ParticleReadback& readback, const char* outputPath)
+{
+	size_t invalid = 0;
+	float minDensity = INFINITY, maxDensity = -INFINITY, maxSpeed = 0.f;
+	glm::vec3 center(0.f);
+	for (size_t i = 0; i < readback.positions.size(); i++)
+	{
+		glm::vec3 position = readback.positions[i];
+		float density = readback.densities[i];
+		if (!std::isfinite(position.x) || !std::isfinite(position.y) || !std::isfinite(position.z) || !std::isfinite(density))
+		{
+			invalid++;
+			continue;
+		}
+		center += position;
+		minDensity = std::min(minDensity, density);
+		maxDensity = std::max(maxDensity, density);
+		maxSpeed = std::max(maxSpeed, glm::length(glm::vec3(readback.velocities[i])));
+	}
+	size_t valid = readback.positions.size() - invalid;
+	if (valid > 0)
+		center /= float(valid);
+
+	std::cout << "particles: " << readback.positions.size() << " (" << invalid << " invalid)" << std::endl;
+	std::cout << "center: " << center.x << " " << center.y << " " << center.z << std::endl;
+	std::cout << "density: " << minDensity << " - " << maxDensity << std::endl;
+	std::cout << "max speed: " << maxSpeed << std::endl;
+	// only the GPU keeps track of it
+	if (readback.simulatedTime > 0.f)
+		std::cout << "simulated time: " << readback.simulatedTime << " s, last step " << readback.timeStep << " s" << std::endl;
+	if (readback.densityIterations > 0.f)
+		std::cout << "dfsph: " << readback.divergenceIterations << " divergence, " << readback.densityIterations
+				  << " density iterations per step, density error " << readback.densityError * 100.f << "%" << std::endl;
+
+	if (outputPath == nullptr)
+		return;
+
+	std::ofstream file(outputPath);
+	if (!file.is_open())
+	{
+		std::cout << "Error when opening " << outputPath << std::endl;
+		return;
+	}
+	file << "x,y,z,vx,vy,vz,density\n";
+	for (size_t i = 0; i < readback.positions.size(); i++)
+	{
+		const glm::vec4& p = readback.positions[i];
+		const glm::vec4& v = readback.velocities[i];
+		file << p.x << ',' << p.y << ',' << p.z << ',' << v.x << ',' << v.y << ',' << v.z << ',' << readback.densities[i] << '\n';
+	}
+}
+
+// run the CPU reference solver from the given starting state, or from the spiral the GPU emits by default
+ParticleReadback runCpuSolver(const SimulationParameters& params, int steps, float dt, const ParticleReadback* start = nullptr)
+{
+	std::vector<glm::vec4> positions(params.particleCount), velocities(params.particleCount);
+	if (start != nullptr)
+	{
+		positions = start->positions;
+		velocities = start->velocities;
+	}
+	else
+		initParticles(params.particleCount, positions.data(), velocities.data());
+
+	CpuSolver solver(params);
+	std::cout << "CPU solver, " << CpuSolver::simdName() << " kernels" << std::endl;
+	solver.setParticles(positions, velocities);
+	for (int i = 0; i < steps; i++)
+		solver.step(dt);
+	return solver.readback();
+}
 
 int main(int argc, char* argv[])
 {
+	int steps = 1000;
+	const char* outputPath = nullptr;
+	bool cpuOnly = false;
+	bool compare = false;
+	bool checkDfsphTolerance = false;
+	float tolerance = 1e-3f;
+
+	// scene size can be changed without rebuilding the shaders
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+		{
+			uint32_t count = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+			if (count > 0)
+				GraphicsGlobal::SIMULATION_PARAMETERS.particleCount = count;
+		}
+		// run the solver without a window, then read back the result and quit
+		else if (std::strcmp(argv[i], "--headless") == 0)
+			GraphicsGlobal::HEADLESS = true;
+		else if (std::strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+			steps = std::max(0, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			outputPath = argv[++i];
+		// CPU reference solver instead of the GPU, no Vulkan needed
+		else if (std::strcmp(argv[i], "--cpu") == 0)
+			cpuOnly = true;
+		// run both solvers headless and check the GPU against the CPU
+		else if (std::strcmp(argv[i], "--compare") == 0)
+			compare = true;
+		// run DFSPH headless at --density-tolerance and ten times it, the tighter one has to iterate more
+		else if (std::strcmp(argv[i], "--check-dfsph-tolerance") == 0)
+			checkDfsphTolerance = true;
+		else if (std::strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+			tolerance = static_cast<float>(std::atof(argv[++i]));
+		// GPU time of every pass, printed every N frames
+		else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+			GraphicsGlobal::PROFILE_INTERVAL = std::max(0, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc)
+			GraphicsGlobal::PROFILE_CSV = argv[++i];
+		// fixed simulation step and how many of them run per frame, 0 follows the frame time
+		else if (std::strcmp(argv[i], "--dt") == 0 && i + 1 < argc)
+		{
+			float timeStep = static_cast<float>(std::atof(argv[++i]));
+			if (timeStep > 0.f)
+				GraphicsGlobal::SIMULATION_PARAMETERS.timeStep = timeStep;
+		}
+		else if (std::strcmp(argv[i], "--substeps") == 0 && i + 1 < argc)
+			GraphicsGlobal::SIMULATION_PARAMETERS.substeps = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+		else if (std::strcmp(argv[i], "--max-substeps") == 0 && i + 1 < argc)
+			GraphicsGlobal::SIMULATION_PARAMETERS.maxSubsteps = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		else if (std::strcmp(argv[i], "--fused") == 0)
+			GraphicsGlobal::SIMULATION_PARAMETERS.fusedIntegration = true;
+		// CFL time step picked on the GPU, --max-dt bounds it
+		else if (std::strcmp(argv[i], "--adaptive-dt") == 0)
+			GraphicsGlobal::SIMULATION_PARAMETERS.adaptiveTimeStep = true;
+		else if (std::strcmp(argv[i], "--cfl") == 0 && i + 1 < argc)
+			GraphicsGlobal::SIMULATION_PARAMETERS.cflFactor = static_cast<float>(std::atof(argv[++i]));
+		else if (std::strcmp(argv[i], "--max-dt") == 0 && i + 1 < argc)
+		{
+			float maxTimeStep = static_cast<float>(std::atof(argv[++i]));
+			if (maxTimeStep > 0.f)
+				GraphicsGlobal::SIMULATION_PARAMETERS.maxTimeStep = maxTimeStep;
+		}
+		// weakly compressible SPH, position based fluids or DFSPH, the overlay switches while running
+		else if (std::strcmp(argv[i], "--solver") == 0 && i + 1 < argc)
+			GraphicsGlobal::SOLVER = solverFromName(argv[++i]);
+		// shape the particles start in, spiral, block, dam or jitter. the CPU solver always starts from the spiral
+		else if (std::strcmp(argv[i], "--emitter") == 0 && i + 1 < argc)
+			GraphicsGlobal::EMITTER = emitterFromName(argv[++i]);
+		// quads with ray traced spheres, a UV sphere mesh per particle or screen space fluid, the overlay switches while running
+		else if (std::strcmp(argv[i], "--renderer") == 0 && i + 1 < argc)
+			GraphicsGlobal::PARTICLE_RENDERER = particleRendererFromName(argv[++i]);
+		// a marching cubes water surface instead of the particles, the overlay switches while running
+		else if (std::strcmp(argv[i], "--surface") == 0)
+			GraphicsGlobal::DRAW_SURFACE = true;
+		else if (std::strcmp(argv[i], "--surface-resolution") == 0 && i + 1 < argc)
+			GraphicsGlobal::SURFACE_RESOLUTION = static_cast<uint32_t>(std::max(2, std::atoi(argv[++i])));
+		else if (std::strcmp(argv[i], "--pbf-iterations") == 0 && i + 1 < argc)
+			GraphicsGlobal::SIMULATION_PARAMETERS.pbfIterations = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		// most Jacobi iterations of the DFSPH density solve, it stops earlier once the error is below the tolerance
+		else if (std::strcmp(argv[i], "--dfsph-iterations") == 0 && i + 1 < argc)
+			GraphicsGlobal::SIMULATION_PARAMETERS.dfsphMaxDensityIterations = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+		else if (std::strcmp(argv[i], "--density-tolerance") == 0 && i + 1 < argc)
+			GraphicsGlobal::SIMULATION_PARAMETERS.densityTolerance = static_cast<float>(std::atof(argv[++i]));
+	}
+
+	if (cpuOnly)
+	{
+		reportHeadless(runCpuSolver(GraphicsGlobal::SIMULATION_PARAMETERS, steps, GraphicsGlobal::SIMULATION_PARAMETERS.timeStep), outputPath);
+		return 0;
+	}
+
+	if (compare)
+	{
+		// particles have to stay in the order they were created to be matched one to one
+		// and the CPU solver only takes fixed SPH steps
+		GraphicsGlobal::HEADLESS = true;
+		GraphicsGlobal::SORT_INTERVAL = 0;
+		GraphicsGlobal::SIMULATION_PARAMETERS.adaptiveTimeStep = false;
+		GraphicsGlobal::SOLVER = Solver::SPH;
+
+		VulkanEngine graphics;
+		graphics.init();
+		// the CPU solver starts from exactly what the GPU emitted, sin and cos differ in the last bits
+		graphics.resetParticles();
+		ParticleReadback start = graphics.readbackParticles();
+		graphics.runHeadless(steps, GraphicsGlobal::SIMULATION_PARAMETERS.timeStep);
+		if (graphics.getProfiler().isEnabled())
+		{
+			std::cout << "GPU timings: ";
+			graphics.getProfiler().printSummary(std::cout);
+		}
+		ParticleReadback gpu = graphics.readbackParticles();
+		graphics.shutdown();
+
+		ParticleReadback cpu = runCpuSolver(GraphicsGlobal::SIMULATION_PARAMETERS, steps, GraphicsGlobal::SIMULATION_PARAMETERS.timeStep, &start);
+		SolverDifference difference = compareParticles(cpu, gpu);
+
+		std::cout << "max relative difference after " << steps << " steps" << std::endl;
+		std::cout << "position: " << difference.position << std::endl;
+		std::cout << "velocity: " << difference.velocity << std::endl;
+		std::cout << "density: " << difference.density << std::endl;
+		std::cout << "invalid particles: " << difference.invalid << std::endl;
+
+		bool passed = difference.invalid == 0 && difference.position <= tolerance &&
+					  difference.velocity <= tolerance && difference.density <= tolerance;
+		std::cout << (passed ? "PASSED" : "FAILED") << " with tolerance " << tolerance << std::endl;
+		return passed ? 0 : 1;
+	}
+
+	if (checkDfsphTolerance)
+	{
+		// the density solve stops on the average error of all particles, meant for large particle counts
+		// where every particle only adds a tiny share of it
+		GraphicsGlobal::HEADLESS = true;
+		GraphicsGlobal::SOLVER = Solver::DFSPH;
+		SimulationParameters& params = GraphicsGlobal::SIMULATION_PARAMETERS;
+		float densityTolerance = params.densityTolerance;
+		std::array<ParticleReadback, 2> results;
+		for (int run = 0; run < 2; run++)
+		{
+			params.densityTolerance = run == 0 ? densityTolerance : densityTolerance * 10.f;
+			VulkanEngine graphics;
+			graphics.init();
+			graphics.runHeadless(steps, params.stepTimeBound());
+			results[run] = graphics.readbackParticles();
+			graphics.shutdown();
+			std::cout << "density tolerance " << params.densityTolerance * 100.f << "%: " << results[run].densityIterations
+					  << " density iterations per step, density error " << results[run].densityError * 100.f << "%" << std::endl;
+		}
+
+		bool passed = results[0].densityIterations > results[1].densityIterations;
+		std::cout << (passed ? "PASSED" : "FAILED") << ", " << params.particleCount << " particles" << std::endl;
+		return passed ? 0 : 1;
+	}
+
+	if (GraphicsGlobal::HEADLESS)
+	{
+		// no window, camera or input, so the graphics system runs on its own
+		VulkanEngine graphics;
+		graphics.init();
+		graphics.runHeadless(steps, GraphicsGlobal::SIMULATION_PARAMETERS.stepTimeBound());
+		if (graphics.getProfiler().isEnabled())
+		{
+			std::cout << "GPU timings: ";
+			graphics.getProfiler().printSummary(std::cout);
+		}
+		reportHeadless(graphics.readbackParticles(), outputPath);
+		graphics.shutdown();
+		return 0;
+	}
+
 	Engine * engine = Engine::getInstance();
 
     // Allocate all necessary systems
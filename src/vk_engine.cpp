@@ -12,23 +12,64 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 #include "Defines.h"
 #include "vk_pipeline.h"
+#include "MarchingCubes.h"
 
 #include "engine.h"
 
+#include "imgui.h"
+#include "imgui_impl_sdl.h"
+#include "imgui_impl_vulkan.h"
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
-int CURRENT_FRAME = 0;
+
+// staging memory the uploads between two frames can use, a partition per frame in flight and one more
+const VkDeviceSize STAGING_PARTITION_SIZE = 8 * 1024 * 1024;
+// uniform data one frame can push
+const VkDeviceSize FRAME_CONSTANTS_SIZE = 64 * 1024;
+// attachments of the screen space fluid pass. every device supports storage on the depth format for the smoothing
+// and additive blending on the thickness format
+const VkFormat FLUID_DEPTH_FORMAT = VK_FORMAT_R32_SFLOAT;
+const VkFormat FLUID_THICKNESS_FORMAT = VK_FORMAT_R16_SFLOAT;
+// largest radius of the depth smoothing in pixels, bounds its cost however close the fluid gets
+const int FLUID_SMOOTH_MAX_RADIUS = 16;
 
 const int GraphicsGlobal::MAX_SHADER_COUNT = 3;
 int GraphicsGlobal::SELECTED_SHADER = 2;
 bool GraphicsGlobal::RESET_PARTICLE = true;
+int GraphicsGlobal::SORT_INTERVAL = 8;
+SimulationParameters GraphicsGlobal::SIMULATION_PARAMETERS;
+bool GraphicsGlobal::HEADLESS = false;
+int GraphicsGlobal::PROFILE_INTERVAL = 0;
+std::string GraphicsGlobal::PROFILE_CSV;
+Solver GraphicsGlobal::SOLVER = Solver::SPH;
+Emitter GraphicsGlobal::EMITTER = Emitter::SPIRAL;
+ParticleRenderer GraphicsGlobal::PARTICLE_RENDERER = ParticleRenderer::IMPOSTOR;
+bool GraphicsGlobal::DRAW_SURFACE = false;
+uint32_t GraphicsGlobal::SURFACE_RESOLUTION = 128;
 
 
 
 void VulkanEngine::init()
 {
+	simParams = GraphicsGlobal::SIMULATION_PARAMETERS;
+	headless = GraphicsGlobal::HEADLESS;
+
+	if (headless)
+	{
+		// nothing is presented, only the compute side of the engine is needed
+		initVulkan();
+		initProfiler();
+		initComputeBuffer();
+		initSyncStructures();
+		initDescriptors();
+		initComputePipelines();
+		isInitialized = true;
+		return;
+	}
+
 	// We initialize SDL and create a window with it. 
 	SDL_Init(SDL_INIT_VIDEO);
 
@@ -45,6 +86,7 @@ void VulkanEngine::init()
 	
 	// vulkan init
 	initVulkan();
+	initProfiler();
 	initSwapchain();
 	initDefaultRenderpass();
 	initFrameBuffers();
@@ -52,8 +94,12 @@ void VulkanEngine::init()
 	initSyncStructures();
 	initDescriptors();
 	initPipeline();
+	initSurface();
+	initFluid();
+	initComputePipelines();
 	loadMeshes();
 	initScene();
+	initImGui();
 	//everything went fine
 	isInitialized = true;
 
@@ -78,89 +124,34 @@ void VulkanEngine::shutdown()
 		// destory allocator
 		vmaDestroyAllocator(allocator);
 		vkDestroyDevice(device, nullptr);
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+		if (!headless)
+			vkDestroySurfaceKHR(instance, surface, nullptr);
 		vkb::destroy_debug_utils_messenger(instance, debugMessenger);
 		vkDestroyInstance(instance, nullptr);
 
-		SDL_DestroyWindow(window);
+		if (window != nullptr)
+			SDL_DestroyWindow(window);
 	}
 }
 
 void VulkanEngine::update(float dt)
 {
-	CURRENT_FRAME = CURRENT_FRAME++ % MAX_FRAMES_IN_FLIGHT;
-	// acqure next sync objects
-	SyncObject * nextSync = graphicsQueueRingBuffer.getNextObject();
-	SyncObject* nextComputeSync = computeQueueRingBuffer.getNextObject();
-
-	
-
-	// compute pipeline
-	// wait for previous compute done
-	VK_CHECK(vkWaitForFences(device, 1, &nextComputeSync->renderFence, true, ONE_SECOND));
-	VK_CHECK(vkResetFences(device, 1, &nextComputeSync->renderFence));
-
-	VkCommandBuffer computeCmd = nextComputeSync->mainCommandBuffer;
-	VkCommandBufferBeginInfo computeCmdBeginInfo = {};
-	computeCmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	computeCmdBeginInfo.pNext = nullptr;
-	computeCmdBeginInfo.pInheritanceInfo = nullptr;
-	computeCmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-	VK_CHECK(vkBeginCommandBuffer(computeCmd, &computeCmdBeginInfo));
-
-	// TODO: move this to compute shader?
-	if (GraphicsGlobal::RESET_PARTICLE)
-	{
-		GraphicsGlobal::RESET_PARTICLE = false;
-		resetParticleInfo(nextComputeSync->commandPool, computeQueue);
-	}
-
-	// compute density
-	vkCmdBindPipeline(computeCmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DensityComputePipeline")->pipeline);
-	vkCmdBindDescriptorSets(computeCmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DensityComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors, 0, nullptr);
-	vkCmdPushConstants(computeCmd, getPipelineSet("DensityComputePipeline")->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(float), &dt);
-
-	// Dispatch the compute shader
-	vkCmdDispatch(computeCmd, MAX_INSTANCE / THREADS_PER_GROUP + 1, 1, 1);
-	
-	VkMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-	vkCmdPipelineBarrier(computeCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	// acqure next sync objects, this only blocks when the frame MAX_FRAMES_IN_FLIGHT ago is still on the GPU. Timeout of 1 second
+	// once it is done its uniform buffer and render copy are free, so the step below can write them right away
+	SyncObject * nextSync = graphicsQueueRingBuffer.getNextObject(ONE_SECOND);
+	int frameSlot = graphicsQueueRingBuffer.getCurrentIndex();
+	frameConstants.beginFrame(frameSlot);
 
-	// compute force
-	vkCmdBindPipeline(computeCmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("ForceComputePipeline")->pipeline);
-	vkCmdBindDescriptorSets(computeCmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("ForceComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors, 0, nullptr);
-	vkCmdDispatch(computeCmd, MAX_INSTANCE / THREADS_PER_GROUP + 1, 1, 1);
-
-
-	vkCmdPipelineBarrier(computeCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
-
-	// update position
-	vkCmdBindPipeline(computeCmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PositionComputePipeline")->pipeline);
-	vkCmdBindDescriptorSets(computeCmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PositionComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors, 0, nullptr);
-	vkCmdDispatch(computeCmd, MAX_INSTANCE / THREADS_PER_GROUP + 1, 1, 1);
-
-	VK_CHECK(vkEndCommandBuffer(computeCmd));
-	std::array<VkSemaphore, 1> computeSignalSemaphores = { nextComputeSync->renderSemaphore };
-	VkPipelineStageFlags computeWaitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
-	VkSubmitInfo computeSubmit = {};
-	computeSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	computeSubmit.pWaitDstStageMask = &computeWaitStage;
-	computeSubmit.signalSemaphoreCount = computeSignalSemaphores.size();
-	computeSubmit.pSignalSemaphores = computeSignalSemaphores.data();
-	computeSubmit.commandBufferCount = 1;
-	computeSubmit.pCommandBuffers = &computeCmd;
+	// the surface buffers take a lot of memory, they only exist once the surface was turned on.
+	// created between frames, the table upload goes with the graphics command buffer of this one
+	if (GraphicsGlobal::DRAW_SURFACE && !surfaceAllocated)
+		allocateSurface();
 
-	vkQueueSubmit(computeQueue, 1, &computeSubmit, nextComputeSync->renderFence);
+	// compute pipeline, runs while the GPU may still be drawing the previous frame
+	// the simulation always advances in fixed steps, as many as the frame time covers
+	simulate(computeQueueRingBuffer.getNextObject(ONE_SECOND), simParams.stepTimeBound(), substepsForFrame(dt), frameSlot);
 
 	// graphics pipeline
-	// wait until the GPU has finished rendering the last frame. Timeout of 1 second
-	VK_CHECK(vkWaitForFences(device, 1, &nextSync->renderFence, true, ONE_SECOND));
-	VK_CHECK(vkResetFences(device, 1, &nextSync->renderFence));
 	//request image from the swapchain, one second timeout
 	uint32_t swapchainImageIndex;
 	VK_CHECK(vkAcquireNextImageKHR(device, swapchain, ONE_SECOND, nextSync->renderSemaphore, nullptr, &swapchainImageIndex));
@@ -169,7 +160,12 @@ void VulkanEngine::update(float dt)
 	//naming it cmd for shorter writing
 	VkCommandBuffer cmd = nextSync->mainCommandBuffer;
 
-	
+	// build the ui before recording, the draw data is recorded inside the render pass
+	ImGui_ImplVulkan_NewFrame();
+	ImGui_ImplSDL2_NewFrame(window);
+	ImGui::NewFrame();
+	drawProfilerOverlay();
+	ImGui::Render();
 
 	//begin the command buffer recording. We will use this command buffer exactly once, so we want to let Vulkan know that
 	VkCommandBufferBeginInfo cmdBeginInfo = {};
@@ -180,6 +176,11 @@ void VulkanEngine::update(float dt)
 
 	VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
+	// meshes uploaded on the transfer queue become ours before anything draws them
+	uint64_t transferWaitValue = hasTransferQueue ? transferUploader.recordAcquire(cmd, graphicsQueueFamily) : 0;
+	// and so do the uploads through the staging ring since the last frame
+	stagingRing.record(cmd);
+
 	//make a clear-color from frame number. This will flash with a 120*pi frame period.
 	VkClearValue clearValue;
 	clearValue.color = { { 0.0f, 0.5f, 0.0f, 1.0f } };
@@ -208,55 +209,122 @@ void VulkanEngine::update(float dt)
 	ubo.model = glm::rotate(glm::mat4{ 1.0f }, glm::radians(frameNumber * 0.4f), glm::vec3(0, 1, 0));
 	ubo.view = cameraPtr->getViewMatrix();
 
+	// the camera goes into the mapped frame constants, no map or unmap per frame
+	uint32_t uboOffset = frameConstants.push(ubo);
+
+	// only the particles in view are drawn, counted on the GPU into the indirect draws.
+	// the surface is built from every particle instead, they are not drawn then
+	// turned on in the overlay of this frame, drawn from the next one
+	bool drawSurface = GraphicsGlobal::DRAW_SURFACE && surfaceAllocated;
+	if (drawSurface)
+		recordSurface(cmd, frameSlot, uboOffset);
+	else
+		recordParticleCull(cmd, frameSlot, uboOffset);
+	// the screen space fluid goes through its own pass first, the main pass only shades it
+	bool drawFluid = !drawSurface && GraphicsGlobal::PARTICLE_RENDERER == ParticleRenderer::FLUID;
+	if (drawFluid)
+		recordFluid(cmd, frameSlot, uboOffset);
 
 	// begin render pass
 	vkCmdBeginRenderPass(cmd, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-	
+	if (drawSurface)
 	{
-		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, renderObjects[0].pipelineSet->pipeline);
+		// as many vertices as the scan counted, no vertex buffer, the vertex shader reads them from storage
+		PipelineSet* surfacePipeline = getPipelineSet("SurfacePipeline");
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, surfacePipeline->pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, surfacePipeline->pipelineLayout, 0, 1, &surfaceDescriptors[frameSlot], 1, &uboOffset);
+		uint32_t drawScope = profiler.beginScope(cmd, "Draw");
+		vkCmdDrawIndirect(cmd, SurfaceBuffer::drawCommandBuffer.buffer, 0, 1, 0);
+		profiler.endScope(cmd, drawScope);
+	}
+	else if (drawFluid)
+	{
+		// a triangle over the screen, the pixels without fluid are discarded
+		PipelineSet* shadePipeline = getPipelineSet("FluidShadePipeline");
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadePipeline->pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, shadePipeline->pipelineLayout, 0, 1, &fluidShadeDescriptor, 1, &uboOffset);
+		uint32_t drawScope = profiler.beginScope(cmd, "Draw");
+		vkCmdDraw(cmd, 3, 1, 0, 0);
+		profiler.endScope(cmd, drawScope);
+	}
+	else
+	{
+		bool impostors = GraphicsGlobal::PARTICLE_RENDERER == ParticleRenderer::IMPOSTOR;
+		PipelineSet* particlePipeline = impostors ? getPipelineSet("ImpostorPipeline") : renderObjects[1].pipelineSet;
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, particlePipeline->pipeline);
 		//bind the mesh vertex buffer with offset 0
 		VkDeviceSize offset = 0;
 		//vkCmdBindVertexBuffers(cmd, 0, 1, &renderObjects[0].mesh->vertexBuffer.buffer, &offset);
-		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, renderObjects[0].pipelineSet->pipelineLayout, 0, 1, &vertexShaderDescriptors[CURRENT_FRAME], 0, nullptr);
-
-		//and copy it to the buffer
-		void* data;
-		vmaMapMemory(allocator, buffers[CURRENT_FRAME].allocation, &data);
-
-		memcpy(data, &ubo, sizeof(UniformBuffer));
-
-		vmaUnmapMemory(allocator, buffers[CURRENT_FRAME].allocation);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, particlePipeline->pipelineLayout, 0, 1, &vertexShaderDescriptors[frameSlot], 1, &uboOffset);
 
 		//we can now draw the mesh
 		// vkCmdDraw(cmd, renderObjects[0].mesh->vertices.size(), 1, 0, 0);
 
-		// draw the sphere
-		vkCmdBindVertexBuffers(cmd, 0, 1, &renderObjects[1].mesh->vertexBuffer.buffer, &offset);
-		vkCmdBindIndexBuffer(cmd, renderObjects[1].mesh->indiceBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-
-		vkCmdDrawIndexed(cmd, static_cast<uint32_t>(renderObjects[1].mesh->indices.size()), MAX_INSTANCE, 0, 0, 0);
+		VkBuffer drawCommands = StorageBuffer::drawCommandBuffers[frameSlot].buffer;
+		uint32_t drawScope = profiler.beginScope(cmd, "Draw");
+		if (impostors)
+		{
+			// six vertices per visible particle and no vertex buffer, the sphere is traced per pixel
+			float radius = SPHERE_RADIUS;
+			vkCmdPushConstants(cmd, particlePipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float), &radius);
+			vkCmdDrawIndirect(cmd, drawCommands, offsetof(ParticleDrawCommands, impostor), 1, 0);
+		}
+		else
+		{
+			// draw the sphere, an instance per visible particle and a draw per level of detail
+			for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+			{
+				vkCmdBindVertexBuffers(cmd, 0, 1, &sphereLods[lod]->vertexBuffer.buffer, &offset);
+				vkCmdBindIndexBuffer(cmd, sphereLods[lod]->indiceBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdDrawIndexedIndirect(cmd, drawCommands, offsetof(ParticleDrawCommands, mesh) + lod * sizeof(VkDrawIndexedIndirectCommand), 1, 0);
+			}
+		}
+		profiler.endScope(cmd, drawScope);
 
 	}
+
+	// ui on top of the scene
+	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
 	
 	//finalize the render pass
 	vkCmdEndRenderPass(cmd);
 	//finalize the command buffer (we can no longer add commands, but it can now be executed)
 	VK_CHECK(vkEndCommandBuffer(cmd));
+	frameConstants.flush();
 
 	//prepare the submission to the queue.
 	//we want to wait on the _presentSemaphore, as that semaphore is signaled when the swapchain is ready
 	//we will signal the _renderSemaphore, to signal that rendering has finished
 
-	//nextSync->presentSemaphore we wait for get the current framebuffer, nextComputeSync->renderSemaphore wair for compute is done
-	std::array<VkSemaphore, 2> waitSemaphores = { nextComputeSync->renderSemaphore, nextSync->renderSemaphore };
-	std::array<VkSemaphore, 1> signalSemaphores = { nextSync->presentSemaphore };
-	VkPipelineStageFlags graphicsWaitStage[] = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	//nextSync->renderSemaphore we wait for get the current framebuffer, the compute timeline for the step just submitted
+	std::vector<VkSemaphore> waitSemaphores = { computeQueueRingBuffer.getTimeline(), nextSync->renderSemaphore };
+	std::array<VkSemaphore, 2> signalSemaphores = { nextSync->presentSemaphore, graphicsQueueRingBuffer.getTimeline() };
+	// the culling pass is the first to read the render copy
+	std::vector<VkPipelineStageFlags> graphicsWaitStage = { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	// values of the binary semaphores are ignored
+	std::vector<uint64_t> waitValues = { computeQueueRingBuffer.getLastSignalValue(), 0 };
+	// and the transfer timeline when uploads were acquired, the acquire barriers are at the top of the command buffer
+	if (transferWaitValue > 0)
+	{
+		waitSemaphores.push_back(transferUploader.getTimeline());
+		graphicsWaitStage.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		waitValues.push_back(transferWaitValue);
+	}
+	std::array<uint64_t, 2> signalValues = { 0, graphicsQueueRingBuffer.signalValue(nextSync) };
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	timelineInfo.pWaitSemaphoreValues = waitValues.data();
+	timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
 	VkSubmitInfo submit = {};
 	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit.pNext = nullptr;
-	submit.pWaitDstStageMask = graphicsWaitStage;
-	submit.waitSemaphoreCount = waitSemaphores.size();
+	submit.pNext = &timelineInfo;
+	submit.pWaitDstStageMask = graphicsWaitStage.data();
+	submit.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
 	submit.pWaitSemaphores = waitSemaphores.data();
 	submit.signalSemaphoreCount = signalSemaphores.size();
 	submit.pSignalSemaphores = signalSemaphores.data();
@@ -264,8 +332,8 @@ void VulkanEngine::update(float dt)
 	submit.pCommandBuffers = &cmd;
 
 	//submit command buffer to the queue and execute it.
-	// _renderFence will now block until the graphic commands finish execution
-	VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, nextSync->renderFence));
+	// the graphics timeline reaches the value of this slot when the graphic commands finish execution
+	VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submit, VK_NULL_HANDLE));
 	// this will put the image we just rendered into the visible window.
 	// we want to wait on the _renderSemaphore for that,
 	// as it's necessary that drawing commands have finished before the image is displayed to the user
@@ -279,9 +347,814 @@ void VulkanEngine::update(float dt)
 	presentInfo.pImageIndices = &swapchainImageIndex;
 
 	VK_CHECK(vkQueuePresentKHR(graphicsQueue, &presentInfo));
+
+	// staging buffers of finished transfers
+	if (hasTransferQueue)
+		transferUploader.collect();
 	
 	//increase the number of frames drawn
 	frameNumber++;
+	reportProfiler();
+}
+
+void VulkanEngine::recordParticleCull(VkCommandBuffer cmd, int frameSlot, uint32_t uboOffset)
+{
+	// start from no visible particle, the graphics ring already waited for the last draw reading this slot
+	// each level draws from its own range of the visible indices
+	ParticleDrawCommands commands = {};
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+	{
+		commands.mesh[lod].indexCount = static_cast<uint32_t>(sphereLods[lod]->indices.size());
+		commands.mesh[lod].firstInstance = lod * simParams.particleCount;
+	}
+	commands.impostor.instanceCount = 1;
+	VkBuffer drawCommands = StorageBuffer::drawCommandBuffers[frameSlot].buffer;
+	vkCmdUpdateBuffer(cmd, drawCommands, 0, sizeof(ParticleDrawCommands), &commands);
+
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	PipelineSet* cull = getPipelineSet("CullComputePipeline");
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, cull->pipelineLayout, 0, 1, &vertexShaderDescriptors[frameSlot], 1, &uboOffset);
+	// projected radius in pixels is the radius scaled by the focal length in pixels over the view depth
+	CullPushConstants pushConstants = {};
+	pushConstants.radius = SPHERE_RADIUS;
+	pushConstants.particleCount = simParams.particleCount;
+	pushConstants.lodCount = GraphicsGlobal::PARTICLE_RENDERER == ParticleRenderer::MESH ? SPHERE_LOD_COUNT : 1;
+	pushConstants.pixelScale = SPHERE_RADIUS * std::abs(ubo.proj[1][1]) * 0.5f * windowExtent.height;
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+		pushConstants.lodMinPixels[lod] = SPHERE_LOD_MIN_PIXELS[lod];
+	vkCmdPushConstants(cmd, cull->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+
+	// matches local_size_x in cullParticles.comp
+	uint32_t cullScope = profiler.beginScope(cmd, "Cull");
+	vkCmdDispatch(cmd, (simParams.particleCount + 255) / 256, 1, 1);
+	profiler.endScope(cmd, cullScope);
+
+	VkMemoryBarrier drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanEngine::recordSurface(VkCommandBuffer cmd, int frameSlot, uint32_t uboOffset)
+{
+	// the field and the triangles are shared by every frame, the draw of the last frame has to be done with them.
+	// the graphics queue is in order so a barrier is enough
+	VkMemoryBarrier reuseBarrier = {};
+	reuseBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	reuseBarrier.srcAccessMask = 0;
+	reuseBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &reuseBarrier, 0, nullptr, 0, nullptr);
+
+	uint32_t surfaceScope = profiler.beginScope(cmd, "Surface");
+	vkCmdFillBuffer(cmd, SurfaceBuffer::fieldBuffer.buffer, 0, SurfaceBuffer::fieldSize, 0);
+
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	// every pass shares the layout, so the set and push constants stay bound across the pipelines
+	PipelineSet* splat = getPipelineSet("SurfaceSplatComputePipeline");
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, splat->pipelineLayout, 0, 1, &surfaceDescriptors[frameSlot], 1, &uboOffset);
+	// the nodes span the whole box. the kernel is as large as the drawn spheres, a particle alone reaches
+	// the iso level a little inside its sphere and neighbors pull the surface out to theirs
+	uint32_t resolution = GraphicsGlobal::SURFACE_RESOLUTION;
+	SurfacePushConstants pushConstants = {};
+	pushConstants.resolution = resolution;
+	pushConstants.particleCount = simParams.particleCount;
+	pushConstants.maxVertices = static_cast<uint32_t>(SurfaceBuffer::vertexSize / sizeof(SurfaceVertex));
+	pushConstants.nodeSpacing = 2.f * BOX_SIZE / (resolution - 1);
+	pushConstants.radius = SPHERE_RADIUS;
+	pushConstants.isoLevel = 0.5f;
+	vkCmdPushConstants(cmd, splat->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SurfacePushConstants), &pushConstants);
+
+	VkMemoryBarrier passBarrier = {};
+	passBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	passBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	// matches SURFACE_GROUP_SIZE in surface.glsl
+	uint32_t cellGroups = static_cast<uint32_t>(SurfaceBuffer::blockSize / sizeof(uint32_t));
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, splat->pipeline);
+	vkCmdDispatch(cmd, (simParams.particleCount + 255) / 256, 1, 1);
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &passBarrier, 0, nullptr, 0, nullptr);
+
+	// vertices per cell and per workgroup of cells
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("SurfaceClassifyComputePipeline")->pipeline);
+	vkCmdDispatch(cmd, cellGroups, 1, 1);
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &passBarrier, 0, nullptr, 0, nullptr);
+
+	// offsets of the workgroups and the vertex count of the draw, a single workgroup
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("SurfaceScanComputePipeline")->pipeline);
+	vkCmdDispatch(cmd, 1, 1, 1);
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &passBarrier, 0, nullptr, 0, nullptr);
+
+	// the triangles, packed at the offsets of the scan
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("SurfaceGenerateComputePipeline")->pipeline);
+	vkCmdDispatch(cmd, cellGroups, 1, 1);
+	profiler.endScope(cmd, surfaceScope);
+
+	VkMemoryBarrier drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanEngine::recordFluid(VkCommandBuffer cmd, int frameSlot, uint32_t uboOffset)
+{
+	// 0 in the depth is no fluid, the shading discards those pixels
+	std::array<VkClearValue, 3> clearValues = {};
+	clearValues[2].depthStencil.depth = 1.f;
+
+	VkRenderPassBeginInfo rpInfo = {};
+	rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	rpInfo.renderPass = fluidRenderPass;
+	rpInfo.framebuffer = fluidFramebuffer;
+	rpInfo.renderArea.extent = windowExtent;
+	rpInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	rpInfo.pClearValues = clearValues.data();
+
+	// the visible impostors twice, nearest depth then summed thickness
+	uint32_t splatScope = profiler.beginScope(cmd, "Fluid");
+	vkCmdBeginRenderPass(cmd, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+	PipelineSet* depthPipeline = getPipelineSet("FluidDepthPipeline");
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPipeline->pipelineLayout, 0, 1, &vertexShaderDescriptors[frameSlot], 1, &uboOffset);
+	float radius = SPHERE_RADIUS;
+	vkCmdPushConstants(cmd, depthPipeline->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float), &radius);
+	VkBuffer drawCommands = StorageBuffer::drawCommandBuffers[frameSlot].buffer;
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPipeline->pipeline);
+	vkCmdDrawIndirect(cmd, drawCommands, offsetof(ParticleDrawCommands, impostor), 1, 0);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipelineSet("FluidThicknessPipeline")->pipeline);
+	vkCmdDrawIndirect(cmd, drawCommands, offsetof(ParticleDrawCommands, impostor), 1, 0);
+	vkCmdEndRenderPass(cmd);
+	profiler.endScope(cmd, splatScope);
+
+	// the smooth image is only ever written before it is read, its old contents can go
+	VkImageMemoryBarrier smoothBarrier = {};
+	smoothBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	smoothBarrier.srcAccessMask = 0;
+	smoothBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	smoothBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	smoothBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	smoothBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	smoothBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	smoothBarrier.image = fluidSmoothImage.image;
+	smoothBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &smoothBarrier);
+
+	// the filter covers worldRadius around the fluid, fewer pixels the further away it is
+	PipelineSet* smooth = getPipelineSet("FluidSmoothComputePipeline");
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, smooth->pipeline);
+	FluidSmoothPushConstants pushConstants = {};
+	pushConstants.maxRadius = FLUID_SMOOTH_MAX_RADIUS;
+	pushConstants.worldRadius = 2.f * SPHERE_RADIUS;
+	pushConstants.pixelScale = std::abs(ubo.proj[1][1]) * 0.5f * windowExtent.height;
+	pushConstants.depthFalloff = SPHERE_RADIUS;
+	// matches local_size in fluidSmooth.comp
+	uint32_t groupsX = (windowExtent.width + 15) / 16;
+	uint32_t groupsY = (windowExtent.height + 15) / 16;
+
+	VkMemoryBarrier passBarrier = {};
+	passBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	passBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	uint32_t smoothScope = profiler.beginScope(cmd, "Smooth");
+	for (int pass = 0; pass < 2; pass++)
+	{
+		if (pass > 0)
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &passBarrier, 0, nullptr, 0, nullptr);
+		pushConstants.direction = pass == 0 ? glm::ivec2(1, 0) : glm::ivec2(0, 1);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, smooth->pipelineLayout, 0, 1, &fluidSmoothDescriptors[pass], 0, nullptr);
+		vkCmdPushConstants(cmd, smooth->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FluidSmoothPushConstants), &pushConstants);
+		vkCmdDispatch(cmd, groupsX, groupsY, 1);
+	}
+	profiler.endScope(cmd, smoothScope);
+
+	// the smoothed depth is sampled by the shading
+	VkImageMemoryBarrier depthBarrier = smoothBarrier;
+	depthBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.image = fluidDepthImage.image;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+}
+
+void VulkanEngine::simulate(SyncObject* computeSync, float dt, uint32_t substeps, int renderSlot)
+{
+	// the ring already waited until the GPU is done with this command buffer
+	currentRenderSlot = renderSlot;
+
+	// so is the DFSPH state it copied out last time
+	int ringSlot = computeQueueRingBuffer.getCurrentIndex();
+	if (dfsphStatsPending[ringSlot])
+	{
+		dfsphStatsPending[ringSlot] = false;
+		const AllocatedBuffer& statsBuffer = dfsphStatsBuffers[ringSlot];
+		vmaInvalidateAllocation(allocator, statsBuffer.allocation, 0, sizeof(DfsphState));
+		void* data;
+		vmaMapMemory(allocator, statsBuffer.allocation, &data);
+		memcpy(&dfsphStats, data, sizeof(DfsphState));
+		vmaUnmapMemory(allocator, statsBuffer.allocation);
+	}
+	clearDfsphCounters = true;
+
+	VkCommandBuffer computeCmd = computeSync->mainCommandBuffer;
+	VkCommandBufferBeginInfo computeCmdBeginInfo = {};
+	computeCmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	computeCmdBeginInfo.pNext = nullptr;
+	computeCmdBeginInfo.pInheritanceInfo = nullptr;
+	computeCmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VK_CHECK(vkBeginCommandBuffer(computeCmd, &computeCmdBeginInfo));
+
+	// the compute submit is the first of a frame, so it starts the profiler frame
+	profiler.beginFrame(computeCmd);
+
+	// buffers uploaded for compute on the transfer queue become ours before the first pass
+	uint64_t transferWaitValue = hasTransferQueue ? transferUploader.recordAcquire(computeCmd, computeQueueFramily) : 0;
+
+	// recorded ahead of the steps, a reset costs one dispatch and never waits for the GPU
+	if (GraphicsGlobal::RESET_PARTICLE)
+	{
+		GraphicsGlobal::RESET_PARTICLE = false;
+		recordParticleReset(computeCmd);
+	}
+
+	// all steps of the frame go into this one command buffer, only the last one writes the render copy
+	for (uint32_t step = 0; step < substeps; step++)
+		recordStep(computeCmd, dt, step + 1 == substeps);
+
+	// nothing to simulate this frame, the render copy still has to hold the current state
+	if (substeps == 0)
+		recordRenderCopy(computeCmd);
+
+	// a DFSPH step ran, hand its counters to the host for when this slot comes around again
+	if (!clearDfsphCounters)
+	{
+		VkMemoryBarrier statsBarrier = {};
+		statsBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		statsBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		statsBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(computeCmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &statsBarrier, 0, nullptr, 0, nullptr);
+
+		VkBufferCopy statsCopy = { 0, 0, sizeof(DfsphState) };
+		vkCmdCopyBuffer(computeCmd, StorageBuffer::dfsphStateBuffer.buffer, dfsphStatsBuffers[ringSlot].buffer, 1, &statsCopy);
+
+		VkMemoryBarrier hostBarrier = {};
+		hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(computeCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+		dfsphStatsPending[ringSlot] = true;
+	}
+
+	VK_CHECK(vkEndCommandBuffer(computeCmd));
+	// the timeline value can be waited on any number of times, by graphics and by the ring when it comes back to this slot
+	VkSemaphore computeTimeline = computeQueueRingBuffer.getTimeline();
+	uint64_t signalValue = computeQueueRingBuffer.signalValue(computeSync);
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+	VkSubmitInfo computeSubmit = {};
+	computeSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	computeSubmit.pNext = &timelineInfo;
+
+	// only waits when it acquired uploads of the transfer queue
+	VkSemaphore transferTimeline = transferUploader.getTimeline();
+	VkPipelineStageFlags transferWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	if (transferWaitValue > 0)
+	{
+		timelineInfo.waitSemaphoreValueCount = 1;
+		timelineInfo.pWaitSemaphoreValues = &transferWaitValue;
+		computeSubmit.waitSemaphoreCount = 1;
+		computeSubmit.pWaitSemaphores = &transferTimeline;
+		computeSubmit.pWaitDstStageMask = &transferWaitStage;
+	}
+	computeSubmit.signalSemaphoreCount = 1;
+	computeSubmit.pSignalSemaphores = &computeTimeline;
+	computeSubmit.commandBufferCount = 1;
+	computeSubmit.pCommandBuffers = &computeCmd;
+
+	VK_CHECK(vkQueueSubmit(computeQueue, 1, &computeSubmit, VK_NULL_HANDLE));
+}
+
+void VulkanEngine::recordStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy)
+{
+	// the previous step in the same command buffer has to be done with every buffer
+	// before the grid is cleared and positions are read again
+	if (stepCount > 0)
+	{
+		VkMemoryBarrier stepBarrier = {};
+		stepBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		stepBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		stepBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &stepBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// only the SPH passes pick their step on the GPU. PBF and DFSPH have no CFL reduction,
+	// so they always take the fixed step the frame accumulator counts in
+	if (GraphicsGlobal::SOLVER == Solver::PBF)
+		recordPbfStep(cmd, simParams.timeStep, writeRenderCopy);
+	else if (GraphicsGlobal::SOLVER == Solver::DFSPH)
+		recordDfsphStep(cmd, simParams.timeStep, writeRenderCopy);
+	else
+		recordSphStep(cmd, dt, writeRenderCopy);
+
+	stepCount++;
+}
+
+void VulkanEngine::recordSphStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// the maxima of the adaptive time step are merged with atomics, start them from zero
+	if (simParams.adaptiveTimeStep)
+	{
+		vkCmdFillBuffer(cmd, StorageBuffer::timeStepBuffer.buffer, 0, offsetof(TimeStepState, dt), 0);
+
+		VkMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	// the brute force searches do not need the grid
+	if (simParams.neighborSearch == NeighborSearch::GRID)
+	{
+		uint32_t gridScope = profiler.beginScope(cmd, "Grid");
+		recordGridBuild(cmd, isReorderStep());
+		profiler.endScope(cmd, gridScope);
+	}
+
+	// compute density
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DensityComputePipeline")->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DensityComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors[currentStorageBuffer][currentRenderSlot], 0, nullptr);
+	// every compute pipeline shares the layout, so these stay bound for force and position pass
+	ComputePushConstants pushConstants = { dt, writeRenderCopy ? 1u : 0u };
+	vkCmdPushConstants(cmd, getPipelineSet("DensityComputePipeline")->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+
+	// Dispatch the compute shader
+	uint32_t densityScope = profiler.beginScope(cmd, "Density");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, densityScope);
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// force and integration in one pass, the particles of the next step land in the other storage buffer
+	if (simParams.useFusedIntegration())
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("ForceIntegrateComputePipeline")->pipeline);
+		uint32_t forceIntegrateScope = profiler.beginScope(cmd, "ForceIntegrate");
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+		profiler.endScope(cmd, forceIntegrateScope);
+
+		currentStorageBuffer = 1 - currentStorageBuffer;
+		return;
+	}
+
+	// compute force
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("ForceComputePipeline")->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("ForceComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors[currentStorageBuffer][currentRenderSlot], 0, nullptr);
+	uint32_t forceScope = profiler.beginScope(cmd, "Force");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, forceScope);
+
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// reduce max speed and acceleration, the position pass derives its step from them on the GPU
+	// so the host never has to read anything back
+	if (simParams.adaptiveTimeStep)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("TimeStepComputePipeline")->pipeline);
+		uint32_t timeStepScope = profiler.beginScope(cmd, "TimeStep");
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+		profiler.endScope(cmd, timeStepScope);
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	// update position
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PositionComputePipeline")->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PositionComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors[currentStorageBuffer][currentRenderSlot], 0, nullptr);
+	uint32_t positionScope = profiler.beginScope(cmd, "Position");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, positionScope);
+}
+
+void VulkanEngine::recordPbfStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// the grid of the step is built on the predicted positions, which can not be reordered
+	// because the start positions have to stay where they are. sort the start positions instead
+	if (isReorderStep())
+	{
+		uint32_t sortScope = profiler.beginScope(cmd, "Grid");
+		recordGridBuild(cmd, true);
+		profiler.endScope(cmd, sortScope);
+	}
+
+	// apply gravity and predict, into the other storage buffer
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PbfPredictComputePipeline")->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PbfPredictComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors[currentStorageBuffer][currentRenderSlot], 0, nullptr);
+	// every compute pipeline shares the layout, so these stay bound for the rest of the step
+	ComputePushConstants pushConstants = { dt, writeRenderCopy ? 1u : 0u };
+	vkCmdPushConstants(cmd, getPipelineSet("PbfPredictComputePipeline")->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+
+	uint32_t predictScope = profiler.beginScope(cmd, "Predict");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, predictScope);
+
+	// the grid build clears the cells the sort may have just read
+	VkMemoryBarrier predictBarrier = {};
+	predictBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	predictBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	predictBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &predictBarrier, 0, nullptr, 0, nullptr);
+
+	// from here on the predicted positions are the current ones and the start positions are bound as the other ones,
+	// the velocity pass writes the current velocities
+	currentStorageBuffer = 1 - currentStorageBuffer;
+
+	uint32_t gridScope = profiler.beginScope(cmd, "Grid");
+	recordGridBuild(cmd, false);
+	profiler.endScope(cmd, gridScope);
+
+	// Jacobi iterations, the corrections of all particles are computed before any of them moves
+	uint32_t constraintScope = profiler.beginScope(cmd, "Constraints");
+	for (uint32_t iteration = 0; iteration < simParams.pbfIterations; iteration++)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PbfLambdaComputePipeline")->pipeline);
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PbfCorrectionComputePipeline")->pipeline);
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PbfApplyComputePipeline")->pipeline);
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+	profiler.endScope(cmd, constraintScope);
+
+	// velocity from the distance moved with XSPH viscosity, writes the render copy
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("PbfVelocityComputePipeline")->pipeline);
+	uint32_t velocityScope = profiler.beginScope(cmd, "Velocity");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, velocityScope);
+}
+
+void VulkanEngine::recordDfsphStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// convergence flags and error sums start over every step, the iteration counters with the submit
+	VkDeviceSize clearSize = clearDfsphCounters ? sizeof(DfsphState) : offsetof(DfsphState, steps);
+	clearDfsphCounters = false;
+	vkCmdFillBuffer(cmd, StorageBuffer::dfsphStateBuffer.buffer, 0, clearSize, 0);
+
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	// every DFSPH pass looks up its neighbors in the grid
+	uint32_t gridScope = profiler.beginScope(cmd, "Grid");
+	recordGridBuild(cmd, isReorderStep());
+	profiler.endScope(cmd, gridScope);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DfsphDensityAlphaComputePipeline")->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DfsphDensityAlphaComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors[currentStorageBuffer][currentRenderSlot], 0, nullptr);
+	// every compute pipeline shares the layout, so these stay bound for the rest of the step
+	ComputePushConstants pushConstants = { dt, writeRenderCopy ? 1u : 0u, 0u };
+	vkCmdPushConstants(cmd, getPipelineSet("DfsphDensityAlphaComputePipeline")->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+
+	uint32_t densityScope = profiler.beginScope(cmd, "DensityAlpha");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, densityScope);
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// make the velocities divergence free before anything is added to them
+	uint32_t divergenceScope = profiler.beginScope(cmd, "Divergence");
+	recordDfsphSolve(cmd, "DfsphDivergenceKappaComputePipeline", "DfsphDivergenceCorrectComputePipeline", simParams.dfsphMaxDivergenceIterations);
+	profiler.endScope(cmd, divergenceScope);
+
+	// gravity and XSPH viscosity, into the force buffer
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DfsphPredictComputePipeline")->pipeline);
+	uint32_t predictScope = profiler.beginScope(cmd, "Predict");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, predictScope);
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// correct the predicted velocities until the density they lead to is close to the rest density
+	uint32_t densitySolveScope = profiler.beginScope(cmd, "DensitySolve");
+	recordDfsphSolve(cmd, "DfsphDensityKappaComputePipeline", "DfsphDensityCorrectComputePipeline", simParams.dfsphMaxDensityIterations);
+	profiler.endScope(cmd, densitySolveScope);
+
+	// move with the corrected velocities, writes the render copy
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("DfsphIntegrateComputePipeline")->pipeline);
+	uint32_t integrateScope = profiler.beginScope(cmd, "Integrate");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, integrateScope);
+}
+
+void VulkanEngine::recordDfsphSolve(VkCommandBuffer cmd, const char* kappaPipeline, const char* correctPipeline, uint32_t maxIterations)
+{
+	// the correction pass writes what the next stiffness pass reads and the other way round
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	// the error is only known on the GPU, so every iteration is recorded and the
+	// passes check the convergence flag first. reading it back would stall the queue
+	for (uint32_t iteration = 0; iteration < maxIterations; iteration++)
+	{
+		vkCmdPushConstants(cmd, getPipelineSet(kappaPipeline)->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, offsetof(ComputePushConstants, iteration), sizeof(uint32_t), &iteration);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet(kappaPipeline)->pipeline);
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet(correctPipeline)->pipeline);
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
+
+void VulkanEngine::recordRenderCopy(VkCommandBuffer cmd)
+{
+	// the last position pass may still be writing the simulation buffers
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy positionCopy = { 0, 0, StorageBuffer::positionSize };
+	vkCmdCopyBuffer(cmd, StorageBuffer::positionBuffers[currentStorageBuffer].buffer, StorageBuffer::renderPositionBuffers[currentRenderSlot].buffer, 1, &positionCopy);
+	VkBufferCopy velocityCopy = { 0, 0, StorageBuffer::velocitySize };
+	vkCmdCopyBuffer(cmd, StorageBuffer::velocityBuffers[currentStorageBuffer].buffer, StorageBuffer::renderVelocityBuffers[currentRenderSlot].buffer, 1, &velocityCopy);
+}
+
+uint32_t VulkanEngine::substepsForFrame(float dt)
+{
+	if (simParams.substeps > 0)
+		return simParams.substeps;
+
+	// fixed timestep accumulator, leftover time carries into the next frame
+	timeAccumulator += dt;
+	uint32_t substeps = static_cast<uint32_t>(timeAccumulator / simParams.timeStep);
+	if (substeps > simParams.maxSubsteps)
+	{
+		// too far behind to catch up, drop the rest instead of falling further behind
+		timeAccumulator = 0.f;
+		return simParams.maxSubsteps;
+	}
+	timeAccumulator -= substeps * simParams.timeStep;
+	return substeps;
+}
+
+void VulkanEngine::runHeadless(int steps, float dt)
+{
+	// several steps per submit like a frame would record, fixed substeps or the most the accumulator allows
+	int stepsPerSubmit = static_cast<int>(simParams.substeps > 0 ? simParams.substeps : simParams.maxSubsteps);
+	for (int i = 0; i < steps; i += stepsPerSubmit)
+	{
+		// a step on a software device can take longer than a second, nothing reads the render copies
+		uint32_t substeps = static_cast<uint32_t>(std::min(stepsPerSubmit, steps - i));
+		simulate(computeQueueRingBuffer.getNextObject(), dt, substeps, frameNumber % MAX_FRAMES_IN_FLIGHT);
+		frameNumber++;
+		reportProfiler();
+	}
+
+	VK_CHECK(vkQueueWaitIdle(computeQueue));
+	// the last frames are still in the pools
+	profiler.collectAll();
+}
+
+std::string VulkanEngine::getDeviceName() const
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(gpuDevice, &properties);
+	return properties.deviceName;
+}
+
+void VulkanEngine::reportProfiler()
+{
+	if (GraphicsGlobal::PROFILE_INTERVAL <= 0 || !profiler.isEnabled() || frameNumber % GraphicsGlobal::PROFILE_INTERVAL != 0)
+		return;
+
+	std::cout << "frame " << frameNumber << ": ";
+	profiler.printSummary(std::cout);
+	if (profileCsv.is_open())
+		profiler.writeCsv(profileCsv, frameNumber);
+}
+
+void VulkanEngine::drawProfilerOverlay()
+{
+	ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), ImGuiCond_FirstUseEver);
+	ImGui::Begin("GPU Timings", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+	ImGui::Text("%u particles", simParams.particleCount);
+	// switching takes effect at the next step, both solvers share the particle state
+	int solver = static_cast<int>(GraphicsGlobal::SOLVER);
+	ImGui::RadioButton("SPH", &solver, static_cast<int>(Solver::SPH));
+	ImGui::SameLine();
+	ImGui::RadioButton("PBF", &solver, static_cast<int>(Solver::PBF));
+	ImGui::SameLine();
+	ImGui::RadioButton("DFSPH", &solver, static_cast<int>(Solver::DFSPH));
+	GraphicsGlobal::SOLVER = static_cast<Solver>(solver);
+	// the emitter only matters for the next reset, space resets as well
+	int emitter = static_cast<int>(GraphicsGlobal::EMITTER);
+	ImGui::RadioButton("Spiral", &emitter, static_cast<int>(Emitter::SPIRAL));
+	ImGui::SameLine();
+	ImGui::RadioButton("Block", &emitter, static_cast<int>(Emitter::BLOCK));
+	ImGui::SameLine();
+	ImGui::RadioButton("Dam", &emitter, static_cast<int>(Emitter::DAM_BREAK));
+	ImGui::SameLine();
+	ImGui::RadioButton("Jitter", &emitter, static_cast<int>(Emitter::JITTER));
+	GraphicsGlobal::EMITTER = static_cast<Emitter>(emitter);
+	if (ImGui::Button("Reset"))
+		GraphicsGlobal::RESET_PARTICLE = true;
+	int renderer = static_cast<int>(GraphicsGlobal::PARTICLE_RENDERER);
+	ImGui::RadioButton("Impostors", &renderer, static_cast<int>(ParticleRenderer::IMPOSTOR));
+	ImGui::SameLine();
+	ImGui::RadioButton("Spheres", &renderer, static_cast<int>(ParticleRenderer::MESH));
+	ImGui::SameLine();
+	ImGui::RadioButton("Fluid", &renderer, static_cast<int>(ParticleRenderer::FLUID));
+	GraphicsGlobal::PARTICLE_RENDERER = static_cast<ParticleRenderer>(renderer);
+	ImGui::Checkbox("Surface", &GraphicsGlobal::DRAW_SURFACE);
+	// a frame or two behind, the counters come back with the ring
+	if (GraphicsGlobal::SOLVER == Solver::DFSPH)
+	{
+		ImGui::Text("divergence %4.1f density %4.1f iterations/step", dfsphStats.averageDivergenceIterations(), dfsphStats.averageDensityIterations());
+		ImGui::Text("density error %.3f%%", dfsphStats.densityErrorRatio(simParams.particleCount) * 100.f);
+	}
+	if (!profiler.isEnabled())
+	{
+		ImGui::Text("timestamps are not supported by the queues");
+		ImGui::End();
+		return;
+	}
+
+	// averaged over the last frames, the last sample alone jumps around too much to read
+	double total = 0.0;
+	for (const GpuProfiler::PassTiming& timing : profiler.getTimings())
+	{
+		ImGui::Text("%-12s %7.3f ms", timing.name.c_str(), timing.averageMs);
+		total += timing.averageMs;
+	}
+	ImGui::Separator();
+	ImGui::Text("%-12s %7.3f ms", "Total", total);
+	ImGui::End();
+}
+
+ParticleReadback VulkanEngine::readbackParticles()
+{
+	VK_CHECK(vkQueueWaitIdle(computeQueue));
+
+	// GPU to CPU staging buffer, all positions first then all velocities then all densities, then the time step and the DFSPH state
+	VkBuffer stagingBuffer;
+	VmaAllocation stagingBufferAllocation;
+
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = StorageBuffer::positionSize + StorageBuffer::velocitySize + StorageBuffer::densitySize + sizeof(TimeStepState) + sizeof(DfsphState);
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &stagingBuffer, &stagingBufferAllocation, nullptr));
+
+	VkDeviceSize densityOffset = StorageBuffer::positionSize + StorageBuffer::velocitySize;
+	VkDeviceSize timeStepOffset = densityOffset + StorageBuffer::densitySize;
+	VkDeviceSize dfsphOffset = timeStepOffset + sizeof(TimeStepState);
+
+	// every copy in one submit
+	immediateSubmit(computeQueueRingBuffer.getCurrentObject()->commandPool, computeQueue, [&](VkCommandBuffer cmd) {
+		VkBufferCopy positionCopy = { 0, 0, StorageBuffer::positionSize };
+		vkCmdCopyBuffer(cmd, StorageBuffer::positionBuffers[currentStorageBuffer].buffer, stagingBuffer, 1, &positionCopy);
+		VkBufferCopy velocityCopy = { 0, StorageBuffer::positionSize, StorageBuffer::velocitySize };
+		vkCmdCopyBuffer(cmd, StorageBuffer::velocityBuffers[currentStorageBuffer].buffer, stagingBuffer, 1, &velocityCopy);
+		VkBufferCopy densityCopy = { 0, densityOffset, StorageBuffer::densitySize };
+		vkCmdCopyBuffer(cmd, StorageBuffer::densityBuffer.buffer, stagingBuffer, 1, &densityCopy);
+		VkBufferCopy timeStepCopy = { 0, timeStepOffset, sizeof(TimeStepState) };
+		vkCmdCopyBuffer(cmd, StorageBuffer::timeStepBuffer.buffer, stagingBuffer, 1, &timeStepCopy);
+		VkBufferCopy dfsphCopy = { 0, dfsphOffset, sizeof(DfsphState) };
+		vkCmdCopyBuffer(cmd, StorageBuffer::dfsphStateBuffer.buffer, stagingBuffer, 1, &dfsphCopy);
+	});
+
+	ParticleReadback readback;
+	readback.positions.resize(simParams.particleCount);
+	readback.velocities.resize(simParams.particleCount);
+	readback.densities.resize(simParams.particleCount);
+
+	void* data;
+	vmaMapMemory(allocator, stagingBufferAllocation, &data);
+	const char* bytes = reinterpret_cast<const char*>(data);
+	memcpy(readback.positions.data(), bytes, StorageBuffer::positionSize);
+	memcpy(readback.velocities.data(), bytes + StorageBuffer::positionSize, StorageBuffer::velocitySize);
+	memcpy(readback.densities.data(), bytes + densityOffset, StorageBuffer::densitySize);
+	TimeStepState timeStepState;
+	memcpy(&timeStepState, bytes + timeStepOffset, sizeof(TimeStepState));
+	readback.timeStep = timeStepState.dt;
+	readback.simulatedTime = timeStepState.time;
+	// counters of the last submit, they only count when it ran DFSPH steps
+	DfsphState dfsphState;
+	memcpy(&dfsphState, bytes + dfsphOffset, sizeof(DfsphState));
+	if (GraphicsGlobal::SOLVER == Solver::DFSPH)
+	{
+		readback.divergenceIterations = dfsphState.averageDivergenceIterations();
+		readback.densityIterations = dfsphState.averageDensityIterations();
+		readback.densityError = dfsphState.densityErrorRatio(simParams.particleCount);
+	}
+	vmaUnmapMemory(allocator, stagingBufferAllocation);
+
+	vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAllocation);
+	return readback;
+}
+
+bool VulkanEngine::isReorderStep() const
+{
+	return GraphicsGlobal::SORT_INTERVAL > 0 && stepCount % GraphicsGlobal::SORT_INTERVAL == 0;
+}
+
+void VulkanEngine::recordGridBuild(VkCommandBuffer cmd, bool reorder)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	// build the uniform grid, clear the cell counters first
+	vkCmdFillBuffer(cmd, GridBuffer::cellBuffer.buffer, 0, GridBuffer::cellSize, 0);
+
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	// count particles in each cell
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("GridCountComputePipeline")->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("GridCountComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors[currentStorageBuffer][currentRenderSlot], 0, nullptr);
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// prefix sum the counts into cell start, a single workgroup is enough for the grid size
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("GridScanComputePipeline")->pipeline);
+	vkCmdDispatch(cmd, 1, 1, 1);
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// write particle indices sorted by cell
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("GridScatterComputePipeline")->pipeline);
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// every few frames copy the particles into cell order in the other storage buffer
+	// so neighbor reads in density and force pass are close in memory
+	if (reorder)
+	{
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("ReorderComputePipeline")->pipeline);
+		vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		currentStorageBuffer = 1 - currentStorageBuffer;
+	}
 }
 
 SystemType VulkanEngine::Type() const
@@ -347,10 +1220,13 @@ void VulkanEngine::loadShaderWrapper(std::string shaderName, VkShaderModule* out
 void VulkanEngine::loadMeshes()
 {
 	meshes["Monkey"].loadFromOBJ("../../assets/monkey_smooth.obj");
-	generateSphere(meshes["Sphere"], 20);
-	// upload the mesh to GPU
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+		generateSphere(meshes["SphereLod" + std::to_string(lod)], SPHERE_LOD_DIVISIONS[lod]);
+	// upload the mesh to GPU, the first frame copies or acquires all of them before it draws
 	uploadMesh(meshes["Monkey"]);
-	uploadMesh(meshes["Sphere"], true);
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+		uploadMesh(meshes["SphereLod" + std::to_string(lod)], true);
+	flushUploads();
 }
 
 void VulkanEngine::uploadMesh(Mesh& mesh, bool indices)
@@ -359,12 +1235,11 @@ void VulkanEngine::uploadMesh(Mesh& mesh, bool indices)
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = mesh.vertices.size() * sizeof(Vertex);
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-
-	// TODO: change this to GPU only and pass the info use staging buffer.
+	// device local, filled from the staging ring
 	VmaAllocationCreateInfo vmaAllocInfo = {};
-	vmaAllocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+	vmaAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
 	// allocate the buffer
 	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &mesh.vertexBuffer.buffer, &mesh.vertexBuffer.allocation, nullptr));
@@ -372,12 +1247,8 @@ void VulkanEngine::uploadMesh(Mesh& mesh, bool indices)
 	// add the destruction of triangle mesh buffer to the deletion queue
 	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, mesh.vertexBuffer.buffer, mesh.vertexBuffer.allocation); });
 
-	// copy the data to gpu
-	// It is possible to keep the pointer mapped and not unmap it immediately, but that is an advanced technique mostly used for streaming data, which we don’t need right now.
-	void * data;
-	vmaMapMemory(allocator, mesh.vertexBuffer.allocation, &data);
-	memcpy(data, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
-	vmaUnmapMemory(allocator, mesh.vertexBuffer.allocation);
+	// copy the data to gpu, meshes are only drawn by the graphics queue
+	uploadBufferAsync(mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex), mesh.vertexBuffer.buffer, graphicsQueueFamily);
 
 	// if has indices buffer
 	if (indices)
@@ -386,7 +1257,7 @@ void VulkanEngine::uploadMesh(Mesh& mesh, bool indices)
 		VkBufferCreateInfo bufferInfo = {};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		bufferInfo.size = mesh.indices.size() * sizeof(uint32_t);
-		bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
 		// allocate the buffer
 		VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &vmaAllocInfo, &mesh.indiceBuffer.buffer, &mesh.indiceBuffer.allocation, nullptr));
@@ -395,13 +1266,30 @@ void VulkanEngine::uploadMesh(Mesh& mesh, bool indices)
 		deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, mesh.indiceBuffer.buffer, mesh.indiceBuffer.allocation); });
 
 		// copy the data to gpu
-		void* data;
-		vmaMapMemory(allocator, mesh.indiceBuffer.allocation, &data);
-		memcpy(data, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
-		vmaUnmapMemory(allocator, mesh.indiceBuffer.allocation);
+		uploadBufferAsync(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), mesh.indiceBuffer.buffer, graphicsQueueFamily);
 	}
 }
 
+void VulkanEngine::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset)
+{
+	stagingRing.upload(data, size, dst, dstOffset);
+}
+
+void VulkanEngine::uploadBufferAsync(const void* data, VkDeviceSize size, VkBuffer dst, uint32_t dstFamily)
+{
+	if (hasTransferQueue)
+		transferUploader.upload(data, size, dst, dstFamily);
+	else
+		uploadBuffer(data, size, dst);
+}
+
+void VulkanEngine::flushUploads()
+{
+	// returns right away, the queue family the uploads are for waits for them
+	if (hasTransferQueue)
+		transferUploader.submit();
+}
+
 void VulkanEngine::initVulkan()
 {
 	vkb::InstanceBuilder builder;
@@ -411,6 +1299,7 @@ void VulkanEngine::initVulkan()
 						  .request_validation_layers(true) // change it when not debug mode?
 						  .require_api_version(1, 3, 0)
 						  .use_default_debug_messenger()
+						  .set_headless(headless) // no surface extensions, works with software devices like lavapipe
 						  .build();
 
 	vkb::Instance vkbInst = instRet.value();
@@ -420,20 +1309,39 @@ void VulkanEngine::initVulkan()
 
 
 	// device
-	SDL_Vulkan_CreateSurface(window, instance, &surface);
+	vkb::PhysicalDeviceSelector selector{ vkbInst };
+	selector.set_minimum_version(1, 3);
+	// both features are only used for drawing, headless runs on compute only devices too
+	if (!headless)
+	{
+		// the sphere levels of detail draw from their own range of the visible indices through firstInstance
+		VkPhysicalDeviceFeatures requiredFeatures = {};
+		requiredFeatures.drawIndirectFirstInstance = VK_TRUE;
+		// the fluid pass writes depth and thickness with different blending from one subpass
+		requiredFeatures.independentBlend = VK_TRUE;
+		selector.set_required_features(requiredFeatures);
+	}
 
 	//use vkbootstrap to select a GPU.
 	//We want a GPU that can write to the SDL surface and supports Vulkan 1.3
-	vkb::PhysicalDeviceSelector selector{ vkbInst };
-	vkb::PhysicalDevice physicalDevice = selector.set_minimum_version(1, 3)
-												 .set_surface(surface)
-												 .select()
-												 .value();
+	//headless only needs compute, the instance being headless stops the selector asking for present support
+	if (!headless)
+	{
+		SDL_Vulkan_CreateSurface(window, instance, &surface);
+		selector.set_surface(surface);
+	}
+
+	vkb::PhysicalDevice physicalDevice = selector.select().value();
 
 	//create the final Vulkan device
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
 
-	vkb::Device vkbDevice = deviceBuilder.build().value();
+	// compute and graphics are paced with timeline semaphores, core since 1.2 but has to be enabled
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	timelineFeatures.timelineSemaphore = VK_TRUE;
+
+	vkb::Device vkbDevice = deviceBuilder.add_pNext(&timelineFeatures).build().value();
 
 	// Get the VkDevice handle used in the rest of a Vulkan application
 	device = vkbDevice.device;
@@ -447,6 +1355,15 @@ void VulkanEngine::initVulkan()
 	computeQueue = vkbDevice.get_queue(vkb::QueueType::compute).value();
 	computeQueueFramily = vkbDevice.get_queue_index(vkb::QueueType::compute).value();
 
+	// a transfer only family copies alongside compute and graphics, without one uploads stay on those queues
+	auto dedicatedTransfer = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer);
+	if (dedicatedTransfer.has_value())
+	{
+		hasTransferQueue = true;
+		transferQueue = dedicatedTransfer.value();
+		transferQueueFamily = vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+	}
+
 	// initialize the memory allocator
 	VmaAllocatorCreateInfo allocatorInfo{};
 	allocatorInfo.physicalDevice = gpuDevice;
@@ -587,6 +1504,64 @@ void VulkanEngine::initDefaultRenderpass()
 
 	VK_CHECK(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
 	deletionQueue.pushFunction([=]() { vkDestroyRenderPass(device, renderPass, nullptr); });
+
+	// the screen space fluid pass, rendered before the main pass. view depth of the nearest sphere
+	// and the summed thickness of all of them, nothing but the smoothing and the shading reads them
+	VkAttachmentDescription fluidDepthAttachment = colorAttachment;
+	fluidDepthAttachment.format = FLUID_DEPTH_FORMAT;
+	// the smoothing reads and writes it as a storage image
+	fluidDepthAttachment.finalLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkAttachmentDescription fluidThicknessAttachment = colorAttachment;
+	fluidThicknessAttachment.format = FLUID_THICKNESS_FORMAT;
+	fluidThicknessAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	// only for the depth test between the spheres
+	VkAttachmentDescription fluidZAttachment = depthAttachment;
+	fluidZAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	fluidZAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+	std::array<VkAttachmentReference, 2> fluidColorRefs = { { { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }, { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL } } };
+	VkAttachmentReference fluidZRef = { 2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+
+	VkSubpassDescription fluidSubpass = {};
+	fluidSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	fluidSubpass.colorAttachmentCount = static_cast<uint32_t>(fluidColorRefs.size());
+	fluidSubpass.pColorAttachments = fluidColorRefs.data();
+	fluidSubpass.pDepthStencilAttachment = &fluidZRef;
+
+	std::array<VkAttachmentDescription, 3> fluidAttachments = { fluidDepthAttachment, fluidThicknessAttachment, fluidZAttachment };
+
+	// the attachments are shared by the frames in flight, the last frame has to be done reading them
+	// before they are cleared. afterwards the smoothing and the shading read them
+	VkSubpassDependency fluidBeginDependency = {};
+	fluidBeginDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	fluidBeginDependency.dstSubpass = 0;
+	fluidBeginDependency.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	fluidBeginDependency.srcAccessMask = 0;
+	fluidBeginDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	fluidBeginDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	VkSubpassDependency fluidEndDependency = {};
+	fluidEndDependency.srcSubpass = 0;
+	fluidEndDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	fluidEndDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	fluidEndDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	fluidEndDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	// the second smoothing pass writes back into the fluid depth
+	fluidEndDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	std::array<VkSubpassDependency, 2> fluidDependencies = { fluidBeginDependency, fluidEndDependency };
+
+	VkRenderPassCreateInfo fluidRenderPassInfo = renderPassInfo;
+	fluidRenderPassInfo.attachmentCount = static_cast<uint32_t>(fluidAttachments.size());
+	fluidRenderPassInfo.pAttachments = fluidAttachments.data();
+	fluidRenderPassInfo.pSubpasses = &fluidSubpass;
+	fluidRenderPassInfo.dependencyCount = static_cast<uint32_t>(fluidDependencies.size());
+	fluidRenderPassInfo.pDependencies = fluidDependencies.data();
+
+	VK_CHECK(vkCreateRenderPass(device, &fluidRenderPassInfo, nullptr, &fluidRenderPass));
+	deletionQueue.pushFunction([=]() { vkDestroyRenderPass(device, fluidRenderPass, nullptr); });
 }
 
 void VulkanEngine::initFrameBuffers()
@@ -624,8 +1599,22 @@ void VulkanEngine::initSyncStructures()
 {
 	// this also init the command buffer stuff
 	graphicsQueueRingBuffer.initSyncObjects(MAX_FRAMES_IN_FLIGHT, device, graphicsQueueFamily);
-	computeQueueRingBuffer.initSyncObjects(1, device, computeQueueFramily); // currently only one buffer for compute pipeline
+	// as many steps in flight as frames, so a step can be recorded while the last one still runs
+	computeQueueRingBuffer.initSyncObjects(MAX_FRAMES_IN_FLIGHT, device, computeQueueFramily);
 
+	// everything uploaded is drawn, so the copies go with the graphics frames. one partition more than
+	// frames in flight, the one after the partition a frame records was read by a frame the ring waited for
+	if (!headless)
+	{
+		stagingRing.init(allocator, STAGING_PARTITION_SIZE, MAX_FRAMES_IN_FLIGHT + 1);
+		deletionQueue.pushFunction([=]() { stagingRing.cleanUp(); });
+	}
+
+	if (hasTransferQueue)
+	{
+		transferUploader.init(device, allocator, transferQueue, transferQueueFamily);
+		deletionQueue.pushFunction([=]() { transferUploader.cleanUp(); });
+	}
 }
 
 PipelineSet* VulkanEngine::recordPipelineSet(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name)
@@ -723,6 +1712,491 @@ void VulkanEngine::initPipeline()
 	// save this pair here
 	recordPipelineSet(meshPipeline, meshPipelineLayout, "GraphicsPipeline");
 
+	vkDestroyShaderModule(device, meshVertShader, nullptr);
+	vkDestroyShaderModule(device, redTriangleFragShader, nullptr);
+
+	deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, meshPipeline, nullptr);
+									   vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr); });
+
+	// impostor pipeline, the quads are built from the vertex index so there is no vertex input
+	VkShaderModule impostorVertShader;
+	loadShaderWrapper("particleImpostor.vert", &impostorVertShader);
+	VkShaderModule impostorFragShader;
+	loadShaderWrapper("particleImpostor.frag", &impostorFragShader);
+
+	// the sphere radius, read by both stages
+	VkPushConstantRange impostorPushConstant;
+	impostorPushConstant.offset = 0;
+	impostorPushConstant.size = sizeof(float);
+	impostorPushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkPipelineLayout impostorPipelineLayout;
+	VkPipelineLayoutCreateInfo impostorPipelineLayoutInfo = meshPipelineLayoutInfo;
+	impostorPipelineLayoutInfo.pushConstantRangeCount = 1;
+	impostorPipelineLayoutInfo.pPushConstantRanges = &impostorPushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &impostorPipelineLayoutInfo, nullptr, &impostorPipelineLayout));
+
+	pipelineBuilder.vertexInputInfo = vkinit::vertexInputStateCreateInfo();
+	// the quads face the camera whichever way their corners wind
+	pipelineBuilder.rasterizer.cullMode = VK_CULL_MODE_NONE;
+	pipelineBuilder.shaderStages.clear();
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, impostorVertShader));
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, impostorFragShader));
+	pipelineBuilder.pipelineLayout = impostorPipelineLayout;
+
+	VkPipeline impostorPipeline = pipelineBuilder.buildPipeline(device, renderPass);
+	recordPipelineSet(impostorPipeline, impostorPipelineLayout, "ImpostorPipeline");
+
+	vkDestroyShaderModule(device, impostorVertShader, nullptr);
+	vkDestroyShaderModule(device, impostorFragShader, nullptr);
+
+	deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, impostorPipeline, nullptr);
+									   vkDestroyPipelineLayout(device, impostorPipelineLayout, nullptr); });
+
+	// frustum culling, a compute pipeline on the graphics queue with the graphics descriptor set
+	VkShaderModule cullComputeShader;
+	loadShaderWrapper("cullParticles.comp", &cullComputeShader);
+
+	VkPushConstantRange cullPushConstant;
+	cullPushConstant.offset = 0;
+	cullPushConstant.size = sizeof(CullPushConstants);
+	cullPushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayout cullPipelineLayout;
+	VkPipelineLayoutCreateInfo cullPipelineLayoutInfo = meshPipelineLayoutInfo;
+	cullPipelineLayoutInfo.pushConstantRangeCount = 1;
+	cullPipelineLayoutInfo.pPushConstantRanges = &cullPushConstant;
+	VK_CHECK(vkCreatePipelineLayout(device, &cullPipelineLayoutInfo, nullptr, &cullPipelineLayout));
+
+	VkComputePipelineCreateInfo cullPipelineInfo{};
+	cullPipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	cullPipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	cullPipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullPipelineInfo.stage.module = cullComputeShader;
+	cullPipelineInfo.stage.pName = "main";
+	cullPipelineInfo.layout = cullPipelineLayout;
+
+	VkPipeline cullPipeline;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &cullPipelineInfo, nullptr, &cullPipeline));
+	recordPipelineSet(cullPipeline, cullPipelineLayout, "CullComputePipeline");
+
+	vkDestroyShaderModule(device, cullComputeShader, nullptr);
+
+	deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, cullPipeline, nullptr);
+									   vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr); });
+}
+
+void VulkanEngine::initSurface()
+{
+	// see surface.glsl for what each binding is, only the draw reads the camera and the vertices
+	std::array<VkDescriptorSetLayoutBinding, 8> surfaceBindings;
+	surfaceBindings[0] = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0);
+	for (uint32_t binding = 1; binding < surfaceBindings.size(); binding++)
+		surfaceBindings[binding] = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, binding);
+	surfaceBindings[6].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutCreateInfo setInfo = {};
+	setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setInfo.bindingCount = static_cast<uint32_t>(surfaceBindings.size());
+	setInfo.pBindings = surfaceBindings.data();
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &surfaceSetLayout));
+	deletionQueue.pushFunction([=]() { vkDestroyDescriptorSetLayout(device, surfaceSetLayout, nullptr); });
+
+	// one layout for the passes and the draw, only the passes read the push constants
+	VkPushConstantRange pushConstant;
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(SurfacePushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &surfaceSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+
+	VkPipelineLayout surfacePipelineLayout;
+	VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &surfacePipelineLayout));
+	deletionQueue.pushFunction([=]() { vkDestroyPipelineLayout(device, surfacePipelineLayout, nullptr); });
+
+	// the passes in the order recordSurface runs them
+	std::array<std::pair<const char*, const char*>, 4> passes =
+	{ {
+		{ "surfaceSplat.comp", "SurfaceSplatComputePipeline" },
+		{ "surfaceClassify.comp", "SurfaceClassifyComputePipeline" },
+		{ "surfaceScan.comp", "SurfaceScanComputePipeline" },
+		{ "surfaceGenerate.comp", "SurfaceGenerateComputePipeline" },
+	} };
+	for (const auto& pass : passes)
+	{
+		VkShaderModule computeShader;
+		loadShaderWrapper(pass.first, &computeShader);
+
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = computeShader;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = surfacePipelineLayout;
+
+		VkPipeline computePipeline;
+		VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &computePipeline));
+		recordPipelineSet(computePipeline, surfacePipelineLayout, pass.second);
+
+		vkDestroyShaderModule(device, computeShader, nullptr);
+		deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, computePipeline, nullptr); });
+	}
+
+	// the draw, vertices come from storage so there is no vertex input
+	VkShaderModule surfaceVertShader;
+	loadShaderWrapper("surface.vert", &surfaceVertShader);
+	VkShaderModule surfaceFragShader;
+	loadShaderWrapper("surface.frag", &surfaceFragShader);
+
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder.vertexInputInfo = vkinit::vertexInputStateCreateInfo();
+	pipelineBuilder.inputAssembly = vkinit::inputAssemblyCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.viewport.x = 0.0f;
+	pipelineBuilder.viewport.y = 0.0f;
+	pipelineBuilder.viewport.width = (float)windowExtent.width;
+	pipelineBuilder.viewport.height = (float)windowExtent.height;
+	pipelineBuilder.viewport.minDepth = 0.0f;
+	pipelineBuilder.viewport.maxDepth = 1.0f;
+	pipelineBuilder.scissor.offset = { 0, 0 };
+	pipelineBuilder.scissor.extent = windowExtent;
+	pipelineBuilder.rasterizer = vkinit::rasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
+	// the inside shows through where the surface leaves the box, both sides are drawn
+	pipelineBuilder.rasterizer.cullMode = VK_CULL_MODE_NONE;
+	pipelineBuilder.multisampling = vkinit::multisamplingStateCreateInfo();
+	pipelineBuilder.colorBlendAttachment = vkinit::colorBlendAttachmentState();
+	pipelineBuilder.depthStencil = vkinit::depthStencilCreateInfo(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, surfaceVertShader));
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, surfaceFragShader));
+	pipelineBuilder.pipelineLayout = surfacePipelineLayout;
+
+	VkPipeline surfacePipeline = pipelineBuilder.buildPipeline(device, renderPass);
+	recordPipelineSet(surfacePipeline, surfacePipelineLayout, "SurfacePipeline");
+
+	vkDestroyShaderModule(device, surfaceVertShader, nullptr);
+	vkDestroyShaderModule(device, surfaceFragShader, nullptr);
+	deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, surfacePipeline, nullptr); });
+}
+
+void VulkanEngine::allocateSurface()
+{
+	uint32_t resolution = GraphicsGlobal::SURFACE_RESOLUTION;
+	uint32_t cellsPerAxis = resolution - 1;
+	uint32_t cellCount = cellsPerAxis * cellsPerAxis * cellsPerAxis;
+	// 256 cells per workgroup, matches SURFACE_GROUP_SIZE in surface.glsl
+	uint32_t cellGroups = (cellCount + 255) / 256;
+	std::vector<int32_t> table = buildMarchingCubesTable();
+
+	SurfaceBuffer::fieldSize = sizeof(uint32_t) * resolution * resolution * resolution;
+	SurfaceBuffer::cellCountSize = sizeof(uint32_t) * cellCount;
+	SurfaceBuffer::blockSize = sizeof(uint32_t) * cellGroups;
+	SurfaceBuffer::tableSize = sizeof(int32_t) * table.size();
+	// a surface crosses about as many cells as a plane through the field, room for a few of them
+	SurfaceBuffer::vertexSize = sizeof(SurfaceVertex) * resolution * resolution * 64;
+
+	// everything is written and read on the graphics queue
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+	struct SurfaceAllocation { AllocatedBuffer* buffer; VkDeviceSize size; VkBufferUsageFlags usage; };
+	std::array<SurfaceAllocation, 6> allocations =
+	{ {
+		{ &SurfaceBuffer::fieldBuffer, SurfaceBuffer::fieldSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		{ &SurfaceBuffer::cellCountBuffer, SurfaceBuffer::cellCountSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		{ &SurfaceBuffer::blockBuffer, SurfaceBuffer::blockSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		{ &SurfaceBuffer::tableBuffer, SurfaceBuffer::tableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		{ &SurfaceBuffer::vertexBuffer, SurfaceBuffer::vertexSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		{ &SurfaceBuffer::drawCommandBuffer, sizeof(VkDrawIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT },
+	} };
+	for (const SurfaceAllocation& allocation : allocations)
+	{
+		AllocatedBuffer& buffer = *allocation.buffer;
+		bufferInfo.size = allocation.size;
+		bufferInfo.usage = allocation.usage;
+		VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, nullptr));
+		deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation); });
+	}
+
+	// copied or acquired by the graphics command buffer of this frame like the meshes, nothing waits
+	uploadBufferAsync(table.data(), SurfaceBuffer::tableSize, SurfaceBuffer::tableBuffer.buffer, graphicsQueueFamily);
+	flushUploads();
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		VkDescriptorSetAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &surfaceSetLayout;
+		VK_CHECK(vkAllocateDescriptorSets(device, &allocateInfo, &surfaceDescriptors[i]));
+
+		std::array<VkDescriptorBufferInfo, 8> bufferInfos =
+		{ {
+			{ frameConstants.getBuffer(), 0, sizeof(UniformBuffer) },
+			{ StorageBuffer::renderPositionBuffers[i].buffer, 0, StorageBuffer::positionSize },
+			{ SurfaceBuffer::fieldBuffer.buffer, 0, SurfaceBuffer::fieldSize },
+			{ SurfaceBuffer::cellCountBuffer.buffer, 0, SurfaceBuffer::cellCountSize },
+			{ SurfaceBuffer::blockBuffer.buffer, 0, SurfaceBuffer::blockSize },
+			{ SurfaceBuffer::tableBuffer.buffer, 0, SurfaceBuffer::tableSize },
+			{ SurfaceBuffer::vertexBuffer.buffer, 0, SurfaceBuffer::vertexSize },
+			{ SurfaceBuffer::drawCommandBuffer.buffer, 0, sizeof(VkDrawIndirectCommand) },
+		} };
+
+		std::array<VkWriteDescriptorSet, 8> setWrites;
+		setWrites[0] = vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, surfaceDescriptors[i], &bufferInfos[0], 0);
+		for (uint32_t binding = 1; binding < setWrites.size(); binding++)
+			setWrites[binding] = vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, surfaceDescriptors[i], &bufferInfos[binding], binding);
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+	surfaceAllocated = true;
+}
+
+void VulkanEngine::initFluid()
+{
+	// window sized like the depth image, allocated the same way
+	VkExtent3D extent = { windowExtent.width, windowExtent.height, 1 };
+	VmaAllocationCreateInfo imageAllocInfo = {};
+	imageAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	imageAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	struct FluidImage { AllocatedImage* image; VkImageView* view; VkFormat format; VkImageUsageFlags usage; VkImageAspectFlags aspect; };
+	std::array<FluidImage, 4> images =
+	{ {
+		{ &fluidDepthImage, &fluidDepthView, FLUID_DEPTH_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT },
+		{ &fluidThicknessImage, &fluidThicknessView, FLUID_THICKNESS_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT },
+		{ &fluidSmoothImage, &fluidSmoothView, FLUID_DEPTH_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT, VK_IMAGE_ASPECT_COLOR_BIT },
+		{ &fluidZImage, &fluidZView, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT },
+	} };
+	for (const FluidImage& fluidImage : images)
+	{
+		AllocatedImage& image = *fluidImage.image;
+		VkImageView& view = *fluidImage.view;
+		VkImageCreateInfo imageInfo = vkinit::imageCreateInfo(fluidImage.format, fluidImage.usage, extent);
+		VK_CHECK(vmaCreateImage(allocator, &imageInfo, &imageAllocInfo, &image.image, &image.allocation, nullptr));
+		VkImageViewCreateInfo viewInfo = vkinit::imageviewCreateInfo(fluidImage.format, image.image, fluidImage.aspect);
+		VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &view));
+		deletionQueue.pushFunction([=]() { vkDestroyImageView(device, view, nullptr);
+										   vmaDestroyImage(allocator, image.image, image.allocation); });
+	}
+
+	std::array<VkImageView, 3> attachments = { fluidDepthView, fluidThicknessView, fluidZView };
+	VkFramebufferCreateInfo framebufferInfo = {};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.renderPass = fluidRenderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = windowExtent.width;
+	framebufferInfo.height = windowExtent.height;
+	framebufferInfo.layers = 1;
+	VK_CHECK(vkCreateFramebuffer(device, &framebufferInfo, nullptr, &fluidFramebuffer));
+	deletionQueue.pushFunction([=]() { vkDestroyFramebuffer(device, fluidFramebuffer, nullptr); });
+
+	// the shading reads texel by texel, 32 bit float formats do not have to support linear filtering
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr, &fluidSampler));
+	deletionQueue.pushFunction([=]() { vkDestroySampler(device, fluidSampler, nullptr); });
+
+	// smoothing, binding 0 is read and binding 1 written, see fluidSmooth.comp
+	std::array<VkDescriptorSetLayoutBinding, 2> smoothBindings =
+	{
+		vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+	};
+	// shading, the camera and the two attachments
+	std::array<VkDescriptorSetLayoutBinding, 3> shadeBindings =
+	{
+		vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+		vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+		vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+	};
+
+	VkDescriptorSetLayoutCreateInfo setInfo = {};
+	setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setInfo.bindingCount = static_cast<uint32_t>(smoothBindings.size());
+	setInfo.pBindings = smoothBindings.data();
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &fluidSmoothSetLayout));
+	setInfo.bindingCount = static_cast<uint32_t>(shadeBindings.size());
+	setInfo.pBindings = shadeBindings.data();
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &setInfo, nullptr, &fluidShadeSetLayout));
+	deletionQueue.pushFunction([=]() { vkDestroyDescriptorSetLayout(device, fluidSmoothSetLayout, nullptr);
+									   vkDestroyDescriptorSetLayout(device, fluidShadeSetLayout, nullptr); });
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+
+	// horizontal from the fluid depth into the smooth image, vertical back
+	std::array<VkImageView, 3> smoothChain = { fluidDepthView, fluidSmoothView, fluidDepthView };
+	allocateInfo.pSetLayouts = &fluidSmoothSetLayout;
+	for (int i = 0; i < 2; i++)
+	{
+		VK_CHECK(vkAllocateDescriptorSets(device, &allocateInfo, &fluidSmoothDescriptors[i]));
+		std::array<VkDescriptorImageInfo, 2> imageInfos =
+		{ {
+			{ VK_NULL_HANDLE, smoothChain[i], VK_IMAGE_LAYOUT_GENERAL },
+			{ VK_NULL_HANDLE, smoothChain[i + 1], VK_IMAGE_LAYOUT_GENERAL },
+		} };
+		std::array<VkWriteDescriptorSet, 2> setWrites =
+		{
+			vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, fluidSmoothDescriptors[i], &imageInfos[0], 0),
+			vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, fluidSmoothDescriptors[i], &imageInfos[1], 1),
+		};
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+	}
+
+	allocateInfo.pSetLayouts = &fluidShadeSetLayout;
+	VK_CHECK(vkAllocateDescriptorSets(device, &allocateInfo, &fluidShadeDescriptor));
+	VkDescriptorBufferInfo camBufferInfo = { frameConstants.getBuffer(), 0, sizeof(UniformBuffer) };
+	VkDescriptorImageInfo depthImageInfo = { fluidSampler, fluidDepthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	VkDescriptorImageInfo thicknessImageInfo = { fluidSampler, fluidThicknessView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	std::array<VkWriteDescriptorSet, 3> shadeWrites =
+	{
+		vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, fluidShadeDescriptor, &camBufferInfo, 0),
+		vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, fluidShadeDescriptor, &depthImageInfo, 1),
+		vkinit::writeDescriptorImage(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, fluidShadeDescriptor, &thicknessImageInfo, 2),
+	};
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(shadeWrites.size()), shadeWrites.data(), 0, nullptr);
+
+	// the splat draws the impostors again, with their vertex shader and layout
+	VkShaderModule impostorVertShader;
+	loadShaderWrapper("particleImpostor.vert", &impostorVertShader);
+	VkShaderModule splatFragShader;
+	loadShaderWrapper("fluidSplat.frag", &splatFragShader);
+	VkPipelineLayout splatPipelineLayout = getPipelineSet("ImpostorPipeline")->pipelineLayout;
+
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder.vertexInputInfo = vkinit::vertexInputStateCreateInfo();
+	pipelineBuilder.inputAssembly = vkinit::inputAssemblyCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	pipelineBuilder.viewport.x = 0.0f;
+	pipelineBuilder.viewport.y = 0.0f;
+	pipelineBuilder.viewport.width = (float)windowExtent.width;
+	pipelineBuilder.viewport.height = (float)windowExtent.height;
+	pipelineBuilder.viewport.minDepth = 0.0f;
+	pipelineBuilder.viewport.maxDepth = 1.0f;
+	pipelineBuilder.scissor.offset = { 0, 0 };
+	pipelineBuilder.scissor.extent = windowExtent;
+	pipelineBuilder.rasterizer = vkinit::rasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
+	pipelineBuilder.rasterizer.cullMode = VK_CULL_MODE_NONE;
+	pipelineBuilder.multisampling = vkinit::multisamplingStateCreateInfo();
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, impostorVertShader));
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, splatFragShader));
+	pipelineBuilder.pipelineLayout = splatPipelineLayout;
+
+	// nearest sphere only: depth tested and written into the depth attachment, the thickness untouched
+	VkPipelineColorBlendAttachmentState writeAttachment = vkinit::colorBlendAttachmentState();
+	VkPipelineColorBlendAttachmentState maskedAttachment = writeAttachment;
+	maskedAttachment.colorWriteMask = 0;
+	VkPipelineColorBlendAttachmentState addAttachment = writeAttachment;
+	addAttachment.blendEnable = VK_TRUE;
+	addAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	addAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	addAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	addAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	addAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	addAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	pipelineBuilder.depthStencil = vkinit::depthStencilCreateInfo(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
+	pipelineBuilder.colorBlendAttachments = { writeAttachment, maskedAttachment };
+	VkPipeline splatDepthPipeline = pipelineBuilder.buildPipeline(device, fluidRenderPass);
+	recordPipelineSet(splatDepthPipeline, splatPipelineLayout, "FluidDepthPipeline");
+
+	// every sphere: no depth test, the thickness summed up and the depth untouched
+	pipelineBuilder.depthStencil = vkinit::depthStencilCreateInfo(false, false, VK_COMPARE_OP_ALWAYS);
+	pipelineBuilder.colorBlendAttachments = { maskedAttachment, addAttachment };
+	VkPipeline splatThicknessPipeline = pipelineBuilder.buildPipeline(device, fluidRenderPass);
+	recordPipelineSet(splatThicknessPipeline, splatPipelineLayout, "FluidThicknessPipeline");
+
+	vkDestroyShaderModule(device, impostorVertShader, nullptr);
+	vkDestroyShaderModule(device, splatFragShader, nullptr);
+
+	// the shading is a triangle over the screen in the main render pass, blended over what is behind the water
+	VkShaderModule shadeVertShader;
+	loadShaderWrapper("fluidShade.vert", &shadeVertShader);
+	VkShaderModule shadeFragShader;
+	loadShaderWrapper("fluidShade.frag", &shadeFragShader);
+
+	VkPipelineLayoutCreateInfo shadePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	shadePipelineLayoutInfo.setLayoutCount = 1;
+	shadePipelineLayoutInfo.pSetLayouts = &fluidShadeSetLayout;
+	VkPipelineLayout shadePipelineLayout;
+	VK_CHECK(vkCreatePipelineLayout(device, &shadePipelineLayoutInfo, nullptr, &shadePipelineLayout));
+
+	VkPipelineColorBlendAttachmentState blendAttachment = vkinit::colorBlendAttachmentState();
+	blendAttachment.blendEnable = VK_TRUE;
+	blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	pipelineBuilder.shaderStages.clear();
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, shadeVertShader));
+	pipelineBuilder.shaderStages.push_back(vkinit::pipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, shadeFragShader));
+	pipelineBuilder.colorBlendAttachments.clear();
+	pipelineBuilder.colorBlendAttachment = blendAttachment;
+	pipelineBuilder.pipelineLayout = shadePipelineLayout;
+	VkPipeline shadePipeline = pipelineBuilder.buildPipeline(device, renderPass);
+	recordPipelineSet(shadePipeline, shadePipelineLayout, "FluidShadePipeline");
+
+	vkDestroyShaderModule(device, shadeVertShader, nullptr);
+	vkDestroyShaderModule(device, shadeFragShader, nullptr);
+
+	// the smoothing, one pipeline for both directions
+	VkShaderModule smoothComputeShader;
+	loadShaderWrapper("fluidSmooth.comp", &smoothComputeShader);
+
+	VkPushConstantRange smoothPushConstant;
+	smoothPushConstant.offset = 0;
+	smoothPushConstant.size = sizeof(FluidSmoothPushConstants);
+	smoothPushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkPipelineLayoutCreateInfo smoothPipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
+	smoothPipelineLayoutInfo.setLayoutCount = 1;
+	smoothPipelineLayoutInfo.pSetLayouts = &fluidSmoothSetLayout;
+	smoothPipelineLayoutInfo.pushConstantRangeCount = 1;
+	smoothPipelineLayoutInfo.pPushConstantRanges = &smoothPushConstant;
+	VkPipelineLayout smoothPipelineLayout;
+	VK_CHECK(vkCreatePipelineLayout(device, &smoothPipelineLayoutInfo, nullptr, &smoothPipelineLayout));
+
+	VkComputePipelineCreateInfo smoothPipelineInfo{};
+	smoothPipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	smoothPipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	smoothPipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	smoothPipelineInfo.stage.module = smoothComputeShader;
+	smoothPipelineInfo.stage.pName = "main";
+	smoothPipelineInfo.layout = smoothPipelineLayout;
+
+	VkPipeline smoothPipeline;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &smoothPipelineInfo, nullptr, &smoothPipeline));
+	recordPipelineSet(smoothPipeline, smoothPipelineLayout, "FluidSmoothComputePipeline");
+
+	vkDestroyShaderModule(device, smoothComputeShader, nullptr);
+
+	deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, splatDepthPipeline, nullptr);
+									   vkDestroyPipeline(device, splatThicknessPipeline, nullptr);
+									   vkDestroyPipeline(device, shadePipeline, nullptr);
+									   vkDestroyPipelineLayout(device, shadePipelineLayout, nullptr);
+									   vkDestroyPipeline(device, smoothPipeline, nullptr);
+									   vkDestroyPipelineLayout(device, smoothPipelineLayout, nullptr); });
+}
+
+void VulkanEngine::initComputePipelines()
+{
 	// pipeline for compute shader
 	VkShaderModule densityComputeShader;
 	loadShaderWrapper("densityCompute.comp", &densityComputeShader);
@@ -733,17 +2207,40 @@ void VulkanEngine::initPipeline()
 	VkShaderModule positionComputeShader;
 	loadShaderWrapper("positionCompute.comp", &positionComputeShader);
 
+	VkShaderModule gridCountComputeShader;
+	loadShaderWrapper("gridCount.comp", &gridCountComputeShader);
+
+	VkShaderModule gridScanComputeShader;
+	loadShaderWrapper("gridScan.comp", &gridScanComputeShader);
+
+	VkShaderModule gridScatterComputeShader;
+	loadShaderWrapper("gridScatter.comp", &gridScatterComputeShader);
+
+	VkShaderModule reorderComputeShader;
+	loadShaderWrapper("reorderParticles.comp", &reorderComputeShader);
+
+	VkShaderModule timeStepComputeShader;
+	loadShaderWrapper("timeStepCompute.comp", &timeStepComputeShader);
+	VkShaderModule forceIntegrateComputeShader;
+	loadShaderWrapper("forceIntegrateCompute.comp", &forceIntegrateComputeShader);
+
 	VkPipelineLayout densityComputePipelineLayout;
 	VkPipeline densityComputePipeline;
 	VkPipeline forceComputePipeline;
 	VkPipeline positionComputePipeline;
+	VkPipeline gridCountComputePipeline;
+	VkPipeline gridScanComputePipeline;
+	VkPipeline gridScatterComputePipeline;
+	VkPipeline reorderComputePipeline;
+	VkPipeline timeStepComputePipeline;
+	VkPipeline forceIntegrateComputePipeline;
 
 	// build the compute pipeline
 	VkPipelineLayoutCreateInfo computePipelineLayoutInfo = vkinit::pipelineLayoutCreateInfo();
 	// push the delta time to compute shader
 	VkPushConstantRange pushConstant;
 	pushConstant.offset = 0;
-	pushConstant.size = sizeof(float);
+	pushConstant.size = sizeof(ComputePushConstants);
 	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
 	computePipelineLayoutInfo.setLayoutCount = 1;
@@ -753,6 +2250,60 @@ void VulkanEngine::initPipeline()
 
 	VK_CHECK(vkCreatePipelineLayout(device, &computePipelineLayoutInfo, nullptr, &densityComputePipelineLayout));
 
+	// scene size, workgroup size and SPH constants go in as specialization constants
+	// so the shaders need no recompiling and the driver can still fold them
+	SpecializationData specializationData = {};
+	specializationData.neighborSearch = static_cast<int>(simParams.neighborSearch);
+	specializationData.particleCount = simParams.particleCount;
+	specializationData.threadsPerGroup = simParams.threadsPerGroup;
+	specializationData.smoothingLength = simParams.smoothingLength;
+	specializationData.stiffness = simParams.stiffness;
+	specializationData.restDensity = simParams.restDensity;
+	specializationData.viscosity = simParams.viscosity;
+	specializationData.gridDim = simParams.gridDim();
+	specializationData.adaptiveTimeStep = simParams.adaptiveTimeStep ? VK_TRUE : VK_FALSE;
+	specializationData.cflFactor = simParams.cflFactor;
+	specializationData.smoothingLengthSquared = simParams.smoothingLength * simParams.smoothingLength;
+	specializationData.poly6Coefficient = simParams.poly6Coefficient();
+	specializationData.spikyCoefficient = simParams.spikyCoefficient();
+	specializationData.viscosityCoefficient = simParams.viscosityCoefficient();
+	specializationData.incompressibleRestDensity = simParams.incompressibleRestDensity();
+	specializationData.pbfRelaxation = simParams.pbfRelaxation;
+	specializationData.xsphViscosity = simParams.xsphViscosity;
+	specializationData.tensileCorrection = simParams.tensileCorrection;
+	specializationData.densityTolerance = simParams.densityTolerance;
+	specializationData.divergenceTolerance = simParams.divergenceTolerance;
+
+	std::array<VkSpecializationMapEntry, 20> specializationEntries =
+	{ {
+		{ 0, offsetof(SpecializationData, neighborSearch), sizeof(int) },
+		{ 1, offsetof(SpecializationData, particleCount), sizeof(uint32_t) },
+		{ 2, offsetof(SpecializationData, threadsPerGroup), sizeof(uint32_t) },
+		{ 3, offsetof(SpecializationData, smoothingLength), sizeof(float) },
+		{ 4, offsetof(SpecializationData, stiffness), sizeof(float) },
+		{ 5, offsetof(SpecializationData, restDensity), sizeof(float) },
+		{ 6, offsetof(SpecializationData, viscosity), sizeof(float) },
+		{ 7, offsetof(SpecializationData, gridDim), sizeof(int) },
+		{ 8, offsetof(SpecializationData, adaptiveTimeStep), sizeof(VkBool32) },
+		{ 9, offsetof(SpecializationData, cflFactor), sizeof(float) },
+		{ 10, offsetof(SpecializationData, smoothingLengthSquared), sizeof(float) },
+		{ 11, offsetof(SpecializationData, poly6Coefficient), sizeof(float) },
+		{ 12, offsetof(SpecializationData, spikyCoefficient), sizeof(float) },
+		{ 13, offsetof(SpecializationData, viscosityCoefficient), sizeof(float) },
+		{ 14, offsetof(SpecializationData, incompressibleRestDensity), sizeof(float) },
+		{ 15, offsetof(SpecializationData, pbfRelaxation), sizeof(float) },
+		{ 16, offsetof(SpecializationData, xsphViscosity), sizeof(float) },
+		{ 17, offsetof(SpecializationData, tensileCorrection), sizeof(float) },
+		{ 18, offsetof(SpecializationData, densityTolerance), sizeof(float) },
+		{ 19, offsetof(SpecializationData, divergenceTolerance), sizeof(float) },
+	} };
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+	specializationInfo.pMapEntries = specializationEntries.data();
+	specializationInfo.dataSize = sizeof(SpecializationData);
+	specializationInfo.pData = &specializationData;
+
 	// compute pipeline info
 	VkComputePipelineCreateInfo pipelineInfo{};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
@@ -760,6 +2311,7 @@ void VulkanEngine::initPipeline()
 	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
 	pipelineInfo.stage.module = densityComputeShader;
 	pipelineInfo.stage.pName = "main"; // Entry point in the shader
+	pipelineInfo.stage.pSpecializationInfo = &specializationInfo; // shaders ignore the constants they do not use
 	pipelineInfo.layout = densityComputePipelineLayout; // Pipeline layout
 
 	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &densityComputePipeline));
@@ -773,19 +2325,84 @@ void VulkanEngine::initPipeline()
 	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &positionComputePipeline));
 	recordPipelineSet(positionComputePipeline, densityComputePipelineLayout, "PositionComputePipeline");
 
+	// pipelines building the uniform grid, share the same layout
+	pipelineInfo.stage.module = gridCountComputeShader;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &gridCountComputePipeline));
+	recordPipelineSet(gridCountComputePipeline, densityComputePipelineLayout, "GridCountComputePipeline");
+
+	pipelineInfo.stage.module = gridScanComputeShader;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &gridScanComputePipeline));
+	recordPipelineSet(gridScanComputePipeline, densityComputePipelineLayout, "GridScanComputePipeline");
+
+	pipelineInfo.stage.module = gridScatterComputeShader;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &gridScatterComputePipeline));
+	recordPipelineSet(gridScatterComputePipeline, densityComputePipelineLayout, "GridScatterComputePipeline");
+
+	pipelineInfo.stage.module = reorderComputeShader;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &reorderComputePipeline));
+	recordPipelineSet(reorderComputePipeline, densityComputePipelineLayout, "ReorderComputePipeline");
+
+	pipelineInfo.stage.module = timeStepComputeShader;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &timeStepComputePipeline));
+	recordPipelineSet(timeStepComputePipeline, densityComputePipelineLayout, "TimeStepComputePipeline");
+
+	pipelineInfo.stage.module = forceIntegrateComputeShader;
+	VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &forceIntegrateComputePipeline));
+	recordPipelineSet(forceIntegrateComputePipeline, densityComputePipelineLayout, "ForceIntegrateComputePipeline");
+
+	// the particle emitter, then position based fluids and DFSPH, built next to the SPH passes
+	// so the solver can be switched at any step
+	const std::array<std::pair<const char*, const char*>, 13> solverShaders =
+	{ {
+		{ "initParticles.comp", "InitParticlesComputePipeline" },
+		{ "pbfPredict.comp", "PbfPredictComputePipeline" },
+		{ "pbfLambda.comp", "PbfLambdaComputePipeline" },
+		{ "pbfCorrection.comp", "PbfCorrectionComputePipeline" },
+		{ "pbfApply.comp", "PbfApplyComputePipeline" },
+		{ "pbfVelocity.comp", "PbfVelocityComputePipeline" },
+		{ "dfsphDensityAlpha.comp", "DfsphDensityAlphaComputePipeline" },
+		{ "dfsphDivergenceKappa.comp", "DfsphDivergenceKappaComputePipeline" },
+		{ "dfsphDivergenceCorrect.comp", "DfsphDivergenceCorrectComputePipeline" },
+		{ "dfsphPredict.comp", "DfsphPredictComputePipeline" },
+		{ "dfsphDensityKappa.comp", "DfsphDensityKappaComputePipeline" },
+		{ "dfsphDensityCorrect.comp", "DfsphDensityCorrectComputePipeline" },
+		{ "dfsphIntegrate.comp", "DfsphIntegrateComputePipeline" },
+	} };
+	for (const auto& [shaderName, pipelineName] : solverShaders)
+	{
+		VkShaderModule shader;
+		loadShaderWrapper(shaderName, &shader);
+
+		VkPipeline pipeline;
+		pipelineInfo.stage.module = shader;
+		VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline));
+		recordPipelineSet(pipeline, densityComputePipelineLayout, pipelineName);
+
+		vkDestroyShaderModule(device, shader, nullptr);
+		deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, pipeline, nullptr); });
+	}
+
 	//deleting all of the vulkan shaders
-	vkDestroyShaderModule(device, meshVertShader, nullptr);
-	vkDestroyShaderModule(device, redTriangleFragShader, nullptr);
 	vkDestroyShaderModule(device, densityComputeShader, nullptr);
 	vkDestroyShaderModule(device, forceComputeShader, nullptr);
 	vkDestroyShaderModule(device, positionComputeShader, nullptr);
+	vkDestroyShaderModule(device, gridCountComputeShader, nullptr);
+	vkDestroyShaderModule(device, gridScanComputeShader, nullptr);
+	vkDestroyShaderModule(device, gridScatterComputeShader, nullptr);
+	vkDestroyShaderModule(device, reorderComputeShader, nullptr);
+	vkDestroyShaderModule(device, timeStepComputeShader, nullptr);
+	vkDestroyShaderModule(device, forceIntegrateComputeShader, nullptr);
 
 	// destroy the pipelines we have created
-	deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, meshPipeline, nullptr);
-									   vkDestroyPipeline(device, densityComputePipeline, nullptr);
+	deletionQueue.pushFunction([=]() { vkDestroyPipeline(device, densityComputePipeline, nullptr);
 									   vkDestroyPipeline(device, forceComputePipeline, nullptr);
 									   vkDestroyPipeline(device, positionComputePipeline, nullptr);
-									   vkDestroyPipelineLayout(device, meshPipelineLayout, nullptr);
+									   vkDestroyPipeline(device, gridCountComputePipeline, nullptr);
+									   vkDestroyPipeline(device, gridScanComputePipeline, nullptr);
+									   vkDestroyPipeline(device, gridScatterComputePipeline, nullptr);
+									   vkDestroyPipeline(device, reorderComputePipeline, nullptr);
+									   vkDestroyPipeline(device, timeStepComputePipeline, nullptr);
+									   vkDestroyPipeline(device, forceIntegrateComputePipeline, nullptr);
 									   vkDestroyPipelineLayout(device, densityComputePipelineLayout, nullptr); });
 }
 
@@ -800,85 +2417,201 @@ void VulkanEngine::initScene()
 	renderObjects.push_back(monkey);
 
 	RenderObject sphere;
-	sphere.mesh = getMesh("Sphere");
+	sphere.mesh = getMesh("SphereLod0");
 	sphere.pipelineSet = getPipelineSet("GraphicsPipeline");
 	sphere.transformMatrix = glm::mat4(1.f);
 
 	renderObjects.push_back(sphere);
+
+	for (int lod = 0; lod < SPHERE_LOD_COUNT; lod++)
+		sphereLods[lod] = getMesh("SphereLod" + std::to_string(lod));
 }
 
 void VulkanEngine::initComputeBuffer() 
 {
-	// this will used for storing all particles information
+	// this will used for storing all particles information, one buffer per attribute
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = sizeof(StorageBuffer);
 	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | 
+						VK_BUFFER_USAGE_TRANSFER_SRC_BIT | // read back, and copied into the render copy
 						VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | 
 						VK_BUFFER_USAGE_VERTEX_BUFFER_BIT; // Used in compute and graphics pipelines
 
 	VmaAllocationCreateInfo allocInfo = {};
 	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-	// allocate the buffer
-	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &StorageBuffer::storageBuffer.buffer, &StorageBuffer::storageBuffer.allocation, nullptr));
+	StorageBuffer::positionSize = sizeof(glm::vec4) * simParams.particleCount;
+	StorageBuffer::velocitySize = sizeof(glm::vec4) * simParams.particleCount;
+	StorageBuffer::forceSize = sizeof(glm::vec4) * simParams.particleCount;
+	StorageBuffer::densitySize = sizeof(float) * simParams.particleCount;
+	StorageBuffer::lambdaSize = sizeof(float) * simParams.particleCount;
+	StorageBuffer::alphaSize = sizeof(float) * simParams.particleCount;
 
-	// add the destruction of buffer to the deletion queue
-	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, StorageBuffer::storageBuffer.buffer, StorageBuffer::storageBuffer.allocation); });
+	// allocate the ping-pong pairs of position and velocity
+	for (int i = 0; i < 2; i++)
+	{
+		AllocatedBuffer& positionBuffer = StorageBuffer::positionBuffers[i];
+		bufferInfo.size = StorageBuffer::positionSize;
+		VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &positionBuffer.buffer, &positionBuffer.allocation, nullptr));
 
-	// init partiles info and upload to the buffer
-	// resetParticleInfo();
-}
-void VulkanEngine::resetParticleInfo(VkCommandPool cmdPool, VkQueue queue)
-{
-	// TODO: move the init particles pos to GPU?
-	// TODO: change this to heap, large array cause stack overflow
-	// StorageBuffer buffer = {};
-	float goldenRatio = (1.0f + std::sqrt(5.0f)) / 2.0f;
-	float angleIncrement = 2.0f * M_PI * goldenRatio;
+		AllocatedBuffer& velocityBuffer = StorageBuffer::velocityBuffers[i];
+		bufferInfo.size = StorageBuffer::velocitySize;
+		VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &velocityBuffer.buffer, &velocityBuffer.allocation, nullptr));
 
-	
+		// add the destruction of buffer to the deletion queue
+		deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, positionBuffer.buffer, positionBuffer.allocation);
+										   vmaDestroyBuffer(allocator, velocityBuffer.buffer, velocityBuffer.allocation); });
+	}
 
-	// create a staging buffer
-	VkBuffer stagingBuffer;
-	VmaAllocation stagingBufferAllocation;
+	// render copies are written by the compute queue and read by the graphics queue without an ownership transfer
+	std::array<uint32_t, 2> queueFamilies = { computeQueueFramily, graphicsQueueFamily };
+	VkBufferCreateInfo renderBufferInfo = bufferInfo;
+	renderBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	if (computeQueueFramily != graphicsQueueFamily)
+	{
+		renderBufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		renderBufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+		renderBufferInfo.pQueueFamilyIndices = queueFamilies.data();
+	}
 
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = sizeof(StorageBuffer);
-	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		AllocatedBuffer& positionBuffer = StorageBuffer::renderPositionBuffers[i];
+		renderBufferInfo.size = StorageBuffer::positionSize;
+		VK_CHECK(vmaCreateBuffer(allocator, &renderBufferInfo, &allocInfo, &positionBuffer.buffer, &positionBuffer.allocation, nullptr));
 
-	VmaAllocationCreateInfo allocInfo = {};
-	allocInfo.usage = VMA_MEMORY_USAGE_CPU_TO_GPU; // Allows CPU access
+		AllocatedBuffer& velocityBuffer = StorageBuffer::renderVelocityBuffers[i];
+		renderBufferInfo.size = StorageBuffer::velocitySize;
+		VK_CHECK(vmaCreateBuffer(allocator, &renderBufferInfo, &allocInfo, &velocityBuffer.buffer, &velocityBuffer.allocation, nullptr));
 
-	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &stagingBuffer, &stagingBufferAllocation, nullptr));
+		deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, positionBuffer.buffer, positionBuffer.allocation);
+										   vmaDestroyBuffer(allocator, velocityBuffer.buffer, velocityBuffer.allocation); });
+	}
 
-	// Map the buffer and copy the initial data
-	void* data;
-	vmaMapMemory(allocator, stagingBufferAllocation, &data);
-	StorageBuffer* buffer = reinterpret_cast<StorageBuffer*>(data);
-	for (size_t i = 0; i < MAX_INSTANCE; i++)
+	// written by the culling pass and read by the draw, both on the graphics queue
+	StorageBuffer::visibleIndexSize = sizeof(uint32_t) * simParams.particleCount * SPHERE_LOD_COUNT;
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		float t = float(i) / float(MAX_INSTANCE);
-		float inclination = std::acos(1.0f - 2.0f * t) * 5;
-		float azimuth = angleIncrement * i;
-
-		buffer->particles[i].pos.x = std::sin(inclination) * std::cos(azimuth);
-		buffer->particles[i].pos.y = std::sin(inclination) * std::sin(azimuth);
-		buffer->particles[i].pos.z = std::cos(inclination);
-		buffer->particles[i].pos.w = 1.f;
+		AllocatedBuffer& visibleBuffer = StorageBuffer::visibleIndexBuffers[i];
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		bufferInfo.size = StorageBuffer::visibleIndexSize;
+		VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &visibleBuffer.buffer, &visibleBuffer.allocation, nullptr));
+
+		AllocatedBuffer& commandBuffer = StorageBuffer::drawCommandBuffers[i];
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferInfo.size = sizeof(ParticleDrawCommands);
+		VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &commandBuffer.buffer, &commandBuffer.allocation, nullptr));
+
+		deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, visibleBuffer.buffer, visibleBuffer.allocation);
+										   vmaDestroyBuffer(allocator, commandBuffer.buffer, commandBuffer.allocation); });
+	}
 
-		buffer->particles[i].velocity = glm::vec4(0, 0, 0, 0);
+	// force and density are only touched by compute shaders
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+	bufferInfo.size = StorageBuffer::forceSize;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &StorageBuffer::forceBuffer.buffer, &StorageBuffer::forceBuffer.allocation, nullptr));
+	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, StorageBuffer::forceBuffer.buffer, StorageBuffer::forceBuffer.allocation); });
+
+	bufferInfo.size = StorageBuffer::densitySize;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &StorageBuffer::densityBuffer.buffer, &StorageBuffer::densityBuffer.allocation, nullptr));
+	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, StorageBuffer::densityBuffer.buffer, StorageBuffer::densityBuffer.allocation); });
+
+	bufferInfo.size = StorageBuffer::lambdaSize;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &StorageBuffer::lambdaBuffer.buffer, &StorageBuffer::lambdaBuffer.allocation, nullptr));
+	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, StorageBuffer::lambdaBuffer.buffer, StorageBuffer::lambdaBuffer.allocation); });
+
+	bufferInfo.size = StorageBuffer::alphaSize;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &StorageBuffer::alphaBuffer.buffer, &StorageBuffer::alphaBuffer.allocation, nullptr));
+	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, StorageBuffer::alphaBuffer.buffer, StorageBuffer::alphaBuffer.allocation); });
+
+	// cleared with vkCmdFillBuffer every step and read back with the particles
+	bufferInfo.size = sizeof(TimeStepState);
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &StorageBuffer::timeStepBuffer.buffer, &StorageBuffer::timeStepBuffer.allocation, nullptr));
+	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, StorageBuffer::timeStepBuffer.buffer, StorageBuffer::timeStepBuffer.allocation); });
+
+	// cleared every step as well, copied into the stats buffers at the end of a submit
+	bufferInfo.size = sizeof(DfsphState);
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &StorageBuffer::dfsphStateBuffer.buffer, &StorageBuffer::dfsphStateBuffer.allocation, nullptr));
+	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, StorageBuffer::dfsphStateBuffer.buffer, StorageBuffer::dfsphStateBuffer.allocation); });
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+	// host readable copies of the DFSPH state, one per compute ring slot
+	VkBufferCreateInfo statsBufferInfo = {};
+	statsBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	statsBufferInfo.size = sizeof(DfsphState);
+	statsBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	VmaAllocationCreateInfo statsAllocInfo = {};
+	statsAllocInfo.usage = VMA_MEMORY_USAGE_GPU_TO_CPU;
+	for (AllocatedBuffer& statsBuffer : dfsphStatsBuffers)
+	{
+		VK_CHECK(vmaCreateBuffer(allocator, &statsBufferInfo, &statsAllocInfo, &statsBuffer.buffer, &statsBuffer.allocation, nullptr));
+		deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, statsBuffer.buffer, statsBuffer.allocation); });
 	}
-	vmaUnmapMemory(allocator, stagingBufferAllocation);
 
-	// upload the data to gpu
-	copyBuffer(cmdPool, queue, stagingBuffer, StorageBuffer::storageBuffer.buffer, sizeof(StorageBuffer));
+	// uniform grid for neighbor search, only touched by compute shaders
+	GridBuffer::cellSize = sizeof(GridCell) * simParams.gridCellCount();
+	GridBuffer::particleCellSize = sizeof(ParticleCell) * simParams.particleCount;
+	GridBuffer::sortedIndexSize = sizeof(uint32_t) * simParams.particleCount;
 
-	vmaDestroyBuffer(allocator, stagingBuffer, stagingBufferAllocation);
+	bufferInfo.size = GridBuffer::particleCellSize;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &GridBuffer::particleCellBuffer.buffer, &GridBuffer::particleCellBuffer.allocation, nullptr));
+
+	bufferInfo.size = GridBuffer::sortedIndexSize;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &GridBuffer::sortedIndexBuffer.buffer, &GridBuffer::sortedIndexBuffer.allocation, nullptr));
+
+	// transfer dst so the cell counters can be cleared with vkCmdFillBuffer
+	bufferInfo.size = GridBuffer::cellSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &GridBuffer::cellBuffer.buffer, &GridBuffer::cellBuffer.allocation, nullptr));
+
+	deletionQueue.pushFunction([=]() { vmaDestroyBuffer(allocator, GridBuffer::cellBuffer.buffer, GridBuffer::cellBuffer.allocation);
+									   vmaDestroyBuffer(allocator, GridBuffer::particleCellBuffer.buffer, GridBuffer::particleCellBuffer.allocation);
+									   vmaDestroyBuffer(allocator, GridBuffer::sortedIndexBuffer.buffer, GridBuffer::sortedIndexBuffer.allocation); });
+}
+void VulkanEngine::recordParticleReset(VkCommandBuffer cmd)
+{
+	// earlier submits may still read or write the buffers the reset overwrites
+	VkMemoryBarrier beginBarrier = {};
+	beginBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	beginBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	beginBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &beginBarrier, 0, nullptr, 0, nullptr);
+
+	// simulated time starts over
+	vkCmdFillBuffer(cmd, StorageBuffer::timeStepBuffer.buffer, 0, sizeof(TimeStepState), 0);
+
+	// every particle computes its own starting state, nothing is uploaded from the host
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("InitParticlesComputePipeline")->pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, getPipelineSet("InitParticlesComputePipeline")->pipelineLayout, 0, 1, &computeDescriptors[currentStorageBuffer][currentRenderSlot], 0, nullptr);
+	ComputePushConstants pushConstants = { 0.f, 0u, 0u, static_cast<uint32_t>(GraphicsGlobal::EMITTER), resetCount++ };
+	vkCmdPushConstants(cmd, getPipelineSet("InitParticlesComputePipeline")->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &pushConstants);
+
+	uint32_t emitScope = profiler.beginScope(cmd, "Emit");
+	vkCmdDispatch(cmd, simParams.groupCount(), 1, 1);
+	profiler.endScope(cmd, emitScope);
+
+	// the steps and the render copy read what the reset wrote
+	VkMemoryBarrier endBarrier = {};
+	endBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	endBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	endBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &endBarrier, 0, nullptr, 0, nullptr);
 }
 
-void VulkanEngine::copyBuffer(VkCommandPool cmdPool, VkQueue queue,VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void VulkanEngine::resetParticles()
+{
+	VK_CHECK(vkQueueWaitIdle(computeQueue));
+	GraphicsGlobal::RESET_PARTICLE = false;
+	immediateSubmit(computeQueueRingBuffer.getCurrentObject()->commandPool, computeQueue, [&](VkCommandBuffer cmd) {
+		// a profiler frame of its own, the timestamp queries have to be reset first
+		profiler.beginFrame(cmd);
+		recordParticleReset(cmd);
+	});
+}
+
+void VulkanEngine::immediateSubmit(VkCommandPool cmdPool, VkQueue queue, std::function<void(VkCommandBuffer)>&& function)
 {
 	VkCommandBufferAllocateInfo allocaInfo{};
 	allocaInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -894,12 +2627,7 @@ void VulkanEngine::copyBuffer(VkCommandPool cmdPool, VkQueue queue,VkBuffer srcB
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
 	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	VkBufferCopy copyRegion{};
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	function(commandBuffer);
 	vkEndCommandBuffer(commandBuffer);
 
 	VkSubmitInfo submitInfo{};
@@ -912,23 +2640,96 @@ void VulkanEngine::copyBuffer(VkCommandPool cmdPool, VkQueue queue,VkBuffer srcB
 
 	vkFreeCommandBuffers(device, cmdPool, 1, &commandBuffer);
 }
+
+void VulkanEngine::initProfiler()
+{
+	// one pool more than the frames in flight, the pool read back is always one the GPU is done with
+	std::vector<uint32_t> queueFamilies = { computeQueueFramily };
+	if (!headless)
+		queueFamilies.push_back(graphicsQueueFamily);
+	// room for the passes of every step of a frame and of the drawing
+	const uint32_t scopesPerStep = 8;
+	const uint32_t scopesPerFrame = 8;
+	uint32_t stepsPerFrame = simParams.substeps > 0 ? simParams.substeps : simParams.maxSubsteps;
+	profiler.init(device, gpuDevice, queueFamilies, MAX_FRAMES_IN_FLIGHT + 1, stepsPerFrame * scopesPerStep + scopesPerFrame);
+	deletionQueue.pushFunction([=]() { profiler.cleanUp(); });
+
+	if (!GraphicsGlobal::PROFILE_CSV.empty())
+	{
+		profileCsv.open(GraphicsGlobal::PROFILE_CSV);
+		if (profileCsv.is_open())
+			GpuProfiler::writeCsvHeader(profileCsv);
+		else
+			std::cout << "Could not open " << GraphicsGlobal::PROFILE_CSV << " for the GPU timings" << std::endl;
+	}
+}
+
+void VulkanEngine::initImGui()
+{
+	// oversized pool for the font texture and whatever the backend needs
+	VkDescriptorPoolSize poolSizes[] =
+	{
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 100 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 100 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 100 },
+	};
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolInfo.maxSets = 100;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(std::size(poolSizes));
+	poolInfo.pPoolSizes = poolSizes;
+
+	VkDescriptorPool imguiPool;
+	VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, nullptr, &imguiPool));
+
+	ImGui::CreateContext();
+	ImGui_ImplSDL2_InitForVulkan(window);
+
+	ImGui_ImplVulkan_InitInfo initInfo = {};
+	initInfo.Instance = instance;
+	initInfo.PhysicalDevice = gpuDevice;
+	initInfo.Device = device;
+	initInfo.QueueFamily = graphicsQueueFamily;
+	initInfo.Queue = graphicsQueue;
+	initInfo.DescriptorPool = imguiPool;
+	initInfo.MinImageCount = static_cast<uint32_t>(swapchainImages.size());
+	initInfo.ImageCount = static_cast<uint32_t>(swapchainImages.size());
+	initInfo.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+	ImGui_ImplVulkan_Init(&initInfo, renderPass);
+
+	// upload the font texture
+	immediateSubmit(graphicsQueueRingBuffer.getCurrentObject()->commandPool, graphicsQueue, [&](VkCommandBuffer cmd) {
+		ImGui_ImplVulkan_CreateFontsTexture(cmd);
+	});
+	ImGui_ImplVulkan_DestroyFontUploadObjects();
+
+	deletionQueue.pushFunction([=]() {
+		ImGui_ImplVulkan_Shutdown();
+		ImGui_ImplSDL2_Shutdown();
+		ImGui::DestroyContext();
+		vkDestroyDescriptorPool(device, imguiPool, nullptr);
+	});
+}
+
 void VulkanEngine::initDescriptors()
 {
 	//information about the binding.
-	VkDescriptorSetLayoutBinding camBufferBinding = {};
-	camBufferBinding.binding = 0;
-	camBufferBinding.descriptorCount = 1;
-	camBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	camBufferBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	// the camera sits somewhere in the frame constants, bound with a dynamic offset
+	// the impostors project their depth in the fragment shader
+	// and the culling pass builds the frustum from it
+	VkShaderStageFlags cameraStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+	VkDescriptorSetLayoutBinding camBufferBinding = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, cameraStages, 0);
 
-	VkDescriptorSetLayoutBinding particleInfoBinding{};
-	particleInfoBinding.binding = 1;
-	particleInfoBinding.descriptorCount = 1;
-	particleInfoBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	particleInfoBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // for graphics pipeline, only read this in vertex shader
-	particleInfoBinding.pImmutableSamplers = nullptr;
+	// for graphics pipeline, only read position and velocity in vertex shader. the culling pass
+	// on the graphics queue shares the set, it reads the positions and writes the visible indices and draw commands
+	VkDescriptorSetLayoutBinding positionBinding = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 1);
+	VkDescriptorSetLayoutBinding velocityBinding = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 2);
+	VkDescriptorSetLayoutBinding visibleBinding = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 3);
+	VkDescriptorSetLayoutBinding drawCommandBinding = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4);
 
-	std::array<VkDescriptorSetLayoutBinding, 2> graphicsBindings = { camBufferBinding, particleInfoBinding };
+	std::array<VkDescriptorSetLayoutBinding, 5> graphicsBindings = { camBufferBinding, positionBinding, velocityBinding, visibleBinding, drawCommandBinding };
 
 	VkDescriptorSetLayoutCreateInfo setinfo = {};
 	setinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -939,14 +2740,10 @@ void VulkanEngine::initDescriptors()
 
 	vkCreateDescriptorSetLayout(device, &setinfo, nullptr, &graphicsSetLayout);
 
-	// add descriptor for compute shader
-	VkDescriptorSetLayoutBinding storageBufferBinding = {};
-	storageBufferBinding.binding = 0;
-	storageBufferBinding.descriptorCount = 1;
-	storageBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	storageBufferBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-
-	std::array<VkDescriptorSetLayoutBinding, 1> computeBindings = { storageBufferBinding };
+	// add descriptor for compute shader, see header.glsl for what each binding is
+	std::array<VkDescriptorSetLayoutBinding, 15> computeBindings;
+	for (uint32_t i = 0; i < computeBindings.size(); i++)
+		computeBindings[i] = vkinit::descriptorsetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i);
 
 	setinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	setinfo.pNext = nullptr;
@@ -959,27 +2756,31 @@ void VulkanEngine::initDescriptors()
 
 	std::vector<VkDescriptorPoolSize> sizes =
 	{
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10 },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 10 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 128 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 8 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 8 },
 	};
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.flags = 0;
-	poolInfo.maxSets = 10;
+	poolInfo.maxSets = 16;
 	poolInfo.poolSizeCount = (uint32_t)sizes.size();
 	poolInfo.pPoolSizes = sizes.data();
 
 	vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool);
 
-	buffers.resize(MAX_FRAMES_IN_FLIGHT);
+	// a partition per frame in flight, the graphics ring waits before a partition is written again
+	frameConstants.init(allocator, gpuDevice, FRAME_CONSTANTS_SIZE, MAX_FRAMES_IN_FLIGHT);
+	deletionQueue.pushFunction([=]() { frameConstants.cleanUp(); });
+
 	vertexShaderDescriptors.resize(MAX_FRAMES_IN_FLIGHT);
 
 	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		buffers[i] = vkinit::createBuffer(allocator, sizeof(UniformBuffer), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
 
-		// allocate one descriptor set for each frame
+		// allocate one descriptor set for each frame, it reads the render copy of the frame
 		VkDescriptorSetAllocateInfo allocateInfo = {};
 		allocateInfo.pNext = nullptr;
 		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -990,77 +2791,66 @@ void VulkanEngine::initDescriptors()
 		vkAllocateDescriptorSets(device, &allocateInfo, &vertexShaderDescriptors[i]);
 
 		// info about the buffer we want to point at in the descriptor
-		VkDescriptorBufferInfo bufferInfo;
-		bufferInfo.buffer = buffers[i].buffer;
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBuffer);
-
-		VkWriteDescriptorSet setWrite = {};
-		setWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		setWrite.pNext = nullptr;
-		setWrite.dstBinding = 0;
-		setWrite.dstSet = vertexShaderDescriptors[i];
-		setWrite.descriptorCount = 1;
-		// type of buffer
-		setWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		setWrite.pBufferInfo = &bufferInfo;
-
-		vkUpdateDescriptorSets(device, 1, &setWrite, 0, nullptr);
-
-		// storage buffer info
-		bufferInfo.buffer = StorageBuffer::storageBuffer.buffer;
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(StorageBuffer);
-
-		setWrite.dstBinding = 1;
-		setWrite.dstSet = vertexShaderDescriptors[i];
-		setWrite.descriptorCount = 1;
-		setWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		setWrite.pBufferInfo = &bufferInfo;
-
-		vkUpdateDescriptorSets(device, 1, &setWrite, 0, nullptr);
+		VkDescriptorBufferInfo camBufferInfo = { frameConstants.getBuffer(), 0, sizeof(UniformBuffer) };
+		VkDescriptorBufferInfo positionBufferInfo = { StorageBuffer::renderPositionBuffers[i].buffer, 0, StorageBuffer::positionSize };
+		VkDescriptorBufferInfo velocityBufferInfo = { StorageBuffer::renderVelocityBuffers[i].buffer, 0, StorageBuffer::velocitySize };
+		VkDescriptorBufferInfo visibleBufferInfo = { StorageBuffer::visibleIndexBuffers[i].buffer, 0, StorageBuffer::visibleIndexSize };
+		VkDescriptorBufferInfo drawCommandBufferInfo = { StorageBuffer::drawCommandBuffers[i].buffer, 0, sizeof(ParticleDrawCommands) };
+
+		std::array<VkWriteDescriptorSet, 5> setWrites =
+		{
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, vertexShaderDescriptors[i], &camBufferInfo, 0),
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, vertexShaderDescriptors[i], &positionBufferInfo, 1),
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, vertexShaderDescriptors[i], &velocityBufferInfo, 2),
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, vertexShaderDescriptors[i], &visibleBufferInfo, 3),
+			vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, vertexShaderDescriptors[i], &drawCommandBufferInfo, 4),
+		};
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
 	}
 
 
-	// TODO: create two storage buffer? read from one, wirte to another.
-	// for compute shader
-	VkDescriptorSetAllocateInfo allocateInfo = {};
-	allocateInfo.pNext = nullptr;
-	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocateInfo.descriptorPool = descriptorPool;
-	allocateInfo.descriptorSetCount = 1;
-	allocateInfo.pSetLayouts = &computeSetLayout;
-
-	vkAllocateDescriptorSets(device, &allocateInfo, &computeDescriptors);
-
-	// info about the buffer we want to point at in the descriptor
-	VkDescriptorBufferInfo bufferInfo;
-	bufferInfo.buffer = StorageBuffer::storageBuffer.buffer;
-	bufferInfo.offset = 0;
-	bufferInfo.range = sizeof(StorageBuffer);
-
-	VkWriteDescriptorSet setWrite = {};
-	setWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	setWrite.pNext = nullptr;
-	setWrite.dstBinding = 0;
-	setWrite.dstSet = computeDescriptors;
-	setWrite.descriptorCount = 1;
-	setWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-	setWrite.pBufferInfo = &bufferInfo;
+	// for compute shader, set [i][j] reads position and velocity i, reorders particles into the other ones
+	// and writes the result of the step into render copy j
+	for (int i = 0; i < 2; i++)
+	for (int j = 0; j < MAX_FRAMES_IN_FLIGHT; j++)
+	{
+		VkDescriptorSetAllocateInfo allocateInfo = {};
+		allocateInfo.pNext = nullptr;
+		allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocateInfo.descriptorPool = descriptorPool;
+		allocateInfo.descriptorSetCount = 1;
+		allocateInfo.pSetLayouts = &computeSetLayout;
 
-	vkUpdateDescriptorSets(device, 1, &setWrite, 0, nullptr);
+		vkAllocateDescriptorSets(device, &allocateInfo, &computeDescriptors[i][j]);
 
-	// add buffers to deletion queues
-	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-	{
-		// error out if uses by reference
-		deletionQueue.pushFunction([=]() {
-			vmaDestroyBuffer(allocator, buffers[i].buffer, buffers[i].allocation);
-			});
+		// info about the buffer we want to point at in the descriptor
+		std::array<VkDescriptorBufferInfo, 15> bufferInfos =
+		{ {
+			{ StorageBuffer::positionBuffers[i].buffer, 0, StorageBuffer::positionSize },
+			{ StorageBuffer::velocityBuffers[i].buffer, 0, StorageBuffer::velocitySize },
+			{ StorageBuffer::forceBuffer.buffer, 0, StorageBuffer::forceSize },
+			{ StorageBuffer::densityBuffer.buffer, 0, StorageBuffer::densitySize },
+			{ GridBuffer::cellBuffer.buffer, 0, GridBuffer::cellSize },
+			{ GridBuffer::particleCellBuffer.buffer, 0, GridBuffer::particleCellSize },
+			{ GridBuffer::sortedIndexBuffer.buffer, 0, GridBuffer::sortedIndexSize },
+			{ StorageBuffer::positionBuffers[1 - i].buffer, 0, StorageBuffer::positionSize },
+			{ StorageBuffer::velocityBuffers[1 - i].buffer, 0, StorageBuffer::velocitySize },
+			{ StorageBuffer::renderPositionBuffers[j].buffer, 0, StorageBuffer::positionSize },
+			{ StorageBuffer::renderVelocityBuffers[j].buffer, 0, StorageBuffer::velocitySize },
+			{ StorageBuffer::timeStepBuffer.buffer, 0, sizeof(TimeStepState) },
+			{ StorageBuffer::lambdaBuffer.buffer, 0, StorageBuffer::lambdaSize },
+			{ StorageBuffer::alphaBuffer.buffer, 0, StorageBuffer::alphaSize },
+			{ StorageBuffer::dfsphStateBuffer.buffer, 0, sizeof(DfsphState) },
+		} };
+
+		std::array<VkWriteDescriptorSet, 15> setWrites;
+		for (uint32_t binding = 0; binding < setWrites.size(); binding++)
+			setWrites[binding] = vkinit::writeDescriptorBuffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, computeDescriptors[i][j], &bufferInfos[binding], binding);
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
 	}
 
-	// vmaDestroyBuffer(allocator, );
-
 	// add descriptor set layout to deletion queues
 	deletionQueue.pushFunction([=]() {
 		vkDestroyDescriptorSetLayout(device, graphicsSetLayout, nullptr);
@@ -7,18 +7,52 @@
 #include <vk_mem_alloc.h>
 #include <unordered_map>
 #include <String>
+#include <fstream>
+#include <functional>
 
 #include "DeletionQueue.h"
 #include "RingBuffer.h"
 #include "Mesh.h"
 #include "SystemBase.h"
 #include "Camera.h"
+#include "SimulationParameters.h"
+#include "GpuProfiler.h"
+#include "StagingRing.h"
+#include "FrameConstants.h"
+#include "AsyncUploader.h"
+
+// how the particles are drawn, switched every frame
+enum class ParticleRenderer : int
+{
+	MESH = 0, // an instanced UV sphere per particle
+	IMPOSTOR, // a quad per particle with the sphere ray traced in the fragment shader
+	FLUID     // the impostors splatted into offscreen depth and thickness, smoothed and shaded as water in screen space
+};
+
+inline ParticleRenderer particleRendererFromName(const char* name)
+{
+	if (std::strcmp(name, "mesh") == 0)
+		return ParticleRenderer::MESH;
+	if (std::strcmp(name, "fluid") == 0)
+		return ParticleRenderer::FLUID;
+	return ParticleRenderer::IMPOSTOR;
+}
 
 namespace GraphicsGlobal 
 {
 	extern const int MAX_SHADER_COUNT;
 	extern int SELECTED_SHADER;
 	extern bool RESET_PARTICLE;
+	extern int SORT_INTERVAL; // reorder particles by grid cell every N frames, 0 disables it
+	extern SimulationParameters SIMULATION_PARAMETERS; // only read when the engine is initialized
+	extern bool HEADLESS; // compute only, no window, swapchain or render pass. only read when the engine is initialized
+	extern int PROFILE_INTERVAL; // print the GPU time of each pass every N frames, 0 disables it
+	extern std::string PROFILE_CSV; // when set the printed timings are also written to this csv file
+	extern Solver SOLVER; // read every step, so it can be switched while running
+	extern Emitter EMITTER; // read on every reset
+	extern ParticleRenderer PARTICLE_RENDERER; // read every frame
+	extern bool DRAW_SURFACE; // a marching cubes surface instead of the particles, read every frame
+	extern uint32_t SURFACE_RESOLUTION; // nodes per axis of the surface field, only read when the engine is initialized
 }
 
 
@@ -51,11 +85,25 @@ public:
 	void update(float) override;
 
 	SystemType Type() const override;
+
+	// headless only, run a fixed number of simulation steps and wait for them to finish
+	// steps are batched into submits like substeps of a frame
+	void runHeadless(int steps, float dt);
+	// copy the current particle state back to the host, waits for the compute queue
+	ParticleReadback readbackParticles();
+	// emit the particles again right away and wait for it, otherwise the next simulate does it
+	void resetParticles();
+	const GpuProfiler& getProfiler() const { return profiler; }
+	GpuProfiler& getProfiler() { return profiler; }
+	std::string getDeviceName() const;
 private:
 	
 	Camera* cameraPtr;
 	UniformBuffer ubo;
 	bool resetParticle = true;
+	bool headless = false;
+	// parameters the buffers and compute pipelines were built with
+	SimulationParameters simParams;
 
 	// basic vulkan
 	VkInstance instance;
@@ -72,6 +120,25 @@ private:
 	VkImageView depthImageView;
 	AllocatedImage depthImage;
 
+	// screen space fluid, window sized. the fluid pass writes view depth and thickness,
+	// the smoothing filters the depth into fluidSmoothImage and back
+	VkRenderPass fluidRenderPass;
+	VkFramebuffer fluidFramebuffer;
+	AllocatedImage fluidDepthImage;
+	AllocatedImage fluidThicknessImage;
+	AllocatedImage fluidSmoothImage;
+	AllocatedImage fluidZImage; // depth test of the fluid pass
+	VkImageView fluidDepthView;
+	VkImageView fluidThicknessView;
+	VkImageView fluidSmoothView;
+	VkImageView fluidZView;
+	VkSampler fluidSampler;
+	VkDescriptorSetLayout fluidSmoothSetLayout;
+	VkDescriptorSetLayout fluidShadeSetLayout;
+	// [0] filters horizontally into the smooth image, [1] vertically back
+	std::array<VkDescriptorSet, 2> fluidSmoothDescriptors;
+	VkDescriptorSet fluidShadeDescriptor;
+
 	VkDescriptorSetLayout graphicsSetLayout;
 	VkDescriptorSetLayout computeSetLayout;
 	VkDescriptorPool descriptorPool;
@@ -83,28 +150,66 @@ private:
 	uint32_t graphicsQueueFamily; //family of that queue
 	VkQueue computeQueue;
 	uint32_t computeQueueFramily;
+	// a queue family with transfer and nothing else, most discrete GPUs have one
+	bool hasTransferQueue = false;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	uint32_t transferQueueFamily = 0;
 
 	// render pass
 	VkRenderPass renderPass;
 	std::vector<VkFramebuffer> framebuffers;
-	// one buffer per frame
-	std::vector<AllocatedBuffer> buffers; // inited in initDescriptors
+	// uniform data of every frame, the camera and whatever else is bound with a dynamic offset
+	FrameConstants frameConstants; // inited in initDescriptors
+	// one set per frame, reads the render copy of that frame
 	std::vector<VkDescriptorSet> vertexShaderDescriptors;
-	VkDescriptorSet computeDescriptors;
+	// set [i][j] reads storage buffer i, reorders into the other one and writes render copy j
+	std::array<std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT>, 2> computeDescriptors;
+	// water surface passes and draw, set i reads render copy i
+	VkDescriptorSetLayout surfaceSetLayout;
+	std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> surfaceDescriptors;
+	bool surfaceAllocated = false;
+	int currentStorageBuffer = 0;
+	// render copy the step being recorded writes
+	int currentRenderSlot = 0;
+	// steps recorded so far, reordering is paced by it
+	int stepCount = 0;
+	// frame time not simulated yet
+	float timeAccumulator = 0.f;
+	// seeds the jitter emitter, counts the resets
+	uint32_t resetCount = 0;
+	// the DFSPH counters start over with the first DFSPH step of a submit
+	bool clearDfsphCounters = true;
+	// DFSPH state copied out at the end of a submit, one per compute ring slot so the host
+	// reads it when it comes back around to the slot instead of waiting for the GPU
+	std::array<AllocatedBuffer, MAX_FRAMES_IN_FLIGHT> dfsphStatsBuffers;
+	std::array<bool, MAX_FRAMES_IN_FLIGHT> dfsphStatsPending = {};
+	// counters of the last submit that ran DFSPH steps, shown in the overlay
+	DfsphState dfsphStats = {};
 
-	// Sync Object
+	// Sync Object, both rings are paced by timeline semaphores
+	// compute runs a step ahead while graphics draws the previous one
 	RingBuffer graphicsQueueRingBuffer;
 	RingBuffer computeQueueRingBuffer;
 
 	// deletion queue
 	DeletionQueue deletionQueue;
 
+	// host to device uploads, copied by the next graphics frame
+	StagingRing stagingRing;
+	// large uploads outside of a frame, only when there is a transfer queue
+	AsyncUploader transferUploader;
+
+	// timestamps around every pass
+	GpuProfiler profiler;
+	std::ofstream profileCsv;
+
 	// memory allocator
 	VmaAllocator allocator;
 
 	// mesh objects
 	std::vector<RenderObject> renderObjects;
-	// TODO: add two more pipeline, one for update particle position, one for construct water surface
+	// the particle sphere at every level of detail, finest first
+	std::array<Mesh*, SPHERE_LOD_COUNT> sphereLods;
 	std::unordered_map<std::string, PipelineSet> pipelineSets;
 	std::unordered_map<std::string, Mesh> meshes;
 
@@ -122,6 +227,15 @@ private:
 	// mesh functions
 	void loadMeshes();
 	void uploadMesh(Mesh & mesh, bool indice = false);
+	// queue copying data into dst through the staging ring, the next frame records the copy
+	// on the graphics queue, so dst has to be a graphics queue buffer
+	void uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dstOffset = 0);
+	// copy data into dst for the queue family dstFamily on the transfer queue, the next submit of that family
+	// waits for it on the GPU. without a transfer queue it goes through uploadBuffer
+	void uploadBufferAsync(const void* data, VkDeviceSize size, VkBuffer dst, uint32_t dstFamily);
+	// submit the uploads queued on the transfer queue, they only make the next submit of their
+	// queue family wait. the staging ring ones need no submit, they go with the next frame
+	void flushUploads();
 
 	void initVulkan();
 	void initSwapchain();
@@ -129,9 +243,53 @@ private:
 	void initFrameBuffers();
 	void initSyncStructures();
 	void initPipeline();
+	void initComputePipelines();
+	void initProfiler();
+	void initImGui();
 	void initDescriptors();
 	void initScene();
 	void initComputeBuffer();
-	void resetParticleInfo(VkCommandPool cmdPool, VkQueue queue);
-	void copyBuffer(VkCommandPool cmdPool, VkQueue queue, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+	// record writing the starting state of every particle with the emitter GraphicsGlobal::EMITTER picks
+	void recordParticleReset(VkCommandBuffer cmd);
+	// record substeps simulation steps into one command buffer and submit it, signals the compute timeline
+	// and leaves the result in the render copy renderSlot
+	void simulate(SyncObject* computeSync, float dt, uint32_t substeps, int renderSlot);
+	// one step of the solver GraphicsGlobal::SOLVER picks
+	void recordStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy);
+	// density, force and position pass, grid build first when it is used
+	void recordSphStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy);
+	// predict, grid build on the predicted positions, constraint iterations and velocity update
+	void recordPbfStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy);
+	// density and alpha factors, divergence solve, prediction, density solve and integration
+	void recordDfsphStep(VkCommandBuffer cmd, float dt, bool writeRenderCopy);
+	// record up to maxIterations of one DFSPH solve, iterations after convergence return right away on the GPU
+	void recordDfsphSolve(VkCommandBuffer cmd, const char* kappaPipeline, const char* correctPipeline, uint32_t maxIterations);
+	// record the frustum culling of the render copy frameSlot, fills the visible indices and draw commands of the slot.
+	// the mesh renderer gets the particles binned by level of detail
+	void recordParticleCull(VkCommandBuffer cmd, int frameSlot, uint32_t uboOffset);
+	// descriptor set layout and pipelines of the water surface
+	void initSurface();
+	// buffers and descriptor sets of the water surface, only the first time it is drawn
+	void allocateSurface();
+	// record splatting the render copy frameSlot into the density field and extracting its surface
+	// with marching cubes, leaves the triangles and their indirect draw in SurfaceBuffer
+	void recordSurface(VkCommandBuffer cmd, int frameSlot, uint32_t uboOffset);
+	// images, framebuffer, descriptor sets and pipelines of the screen space fluid
+	void initFluid();
+	// record the fluid pass over the visible particles of frameSlot and the smoothing of its depth,
+	// the main render pass then shades it with FluidShadePipeline
+	void recordFluid(VkCommandBuffer cmd, int frameSlot, uint32_t uboOffset);
+	// copy the current state into the render copy, for frames without a step
+	void recordRenderCopy(VkCommandBuffer cmd);
+	// how many fixed steps to run for a frame that took dt
+	uint32_t substepsForFrame(float dt);
+	// record clearing and rebuilding the uniform grid, then reordering the particles into it if reorder is set
+	void recordGridBuild(VkCommandBuffer cmd, bool reorder);
+	// particles are reordered every GraphicsGlobal::SORT_INTERVAL steps
+	bool isReorderStep() const;
+	void drawProfilerOverlay();
+	// print and write the pass timings when it is time to
+	void reportProfiler();
+	// record with function into a one time command buffer, submit it and wait for it
+	void immediateSubmit(VkCommandPool cmdPool, VkQueue queue, std::function<void(VkCommandBuffer)>&& function);
 };
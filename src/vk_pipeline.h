@@ -13,6 +13,8 @@ struct PipelineBuilder
 	VkRect2D scissor;
 	VkPipelineRasterizationStateCreateInfo rasterizer;
 	VkPipelineColorBlendAttachmentState colorBlendAttachment;
+	// one per color attachment when the subpass has more than one, colorBlendAttachment is used when empty
+	std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
 	VkPipelineMultisampleStateCreateInfo multisampling;
 	VkPipelineLayout pipelineLayout;
 	VkPipelineDepthStencilStateCreateInfo depthStencil;
@@ -6,6 +6,10 @@
 #include <vk_mem_alloc.h>
 //we will add our main reusable types here
 
+// frames recorded ahead of the GPU. what a frame writes and the next one may still read,
+// like the render copies of the particles, exists once per frame in flight
+const int MAX_FRAMES_IN_FLIGHT = 2;
+
 struct AllocatedBuffer
 {
     VkBuffer buffer;